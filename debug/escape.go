@@ -0,0 +1,62 @@
+package main
+
+// s does not escape
+func sum(s []int, n int) int {
+	t := 0
+	for i := 0; i < n; i++ {
+		t = t + s[i]
+	}
+	return t
+}
+
+// s escapes by return
+func self(s []int) []int {
+	return s
+}
+
+// s escapes by store into another array
+func keep(box [][]int, s []int) {
+	box[0] = s
+}
+
+// the array escapes by return
+func pair(a int, b int) []int {
+	ret := []int{a, b}
+	return ret
+}
+
+func main() {
+	kept := make([][]int, 1)
+	var prev []int
+	for i := 0; i < 3; i++ {
+		cur := make([]int, 1)
+		cur[0] = i
+		if i > 0 {
+			putchar('0' + prev[0])
+		}
+		// cur escapes to prev, so it stays on the heap
+		prev = cur
+	}
+	// on the stack, one slot for all iterations
+	for i := 0; i < 3; i++ {
+		buf := []int{i, i + 1}
+		putchar('0' + sum(buf, 2))
+	}
+	four := []int{4}
+	five := []int{5}
+	a := self(four)
+	b := self(five)
+	putchar('0' + a[0])
+	putchar('0' + b[0])
+	six := []int{6}
+	keep(kept, six)
+	seven := make([]int, 2)
+	keep(kept, seven)
+	kept[0][1] = 7
+	putchar('0' + kept[0][1])
+	p := pair(8, 9)
+	q := pair(1, 2)
+	putchar('0' + p[1])
+	putchar('0' + q[0])
+	putchar('\n')
+}
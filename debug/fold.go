@@ -0,0 +1,21 @@
+package main
+
+var g int = 3*4 + 1
+
+func main() {
+	x := (2 + 3) * -4
+	y := x*10 + 'A' - '0'
+	a := make([]int, 2*5)
+	a[1+1] = 100 / 7 % 5
+	if 1 < 2 && x < 0 {
+		putchar('0' + a[2])
+	}
+	for i := 0; i < 10-7; i++ {
+		putchar('a' + i)
+	}
+	putchar(y%10 + '0')
+	putchar(g + 'A')
+	z := 5 / (2 - 2 + x - x + 1)
+	putchar(z + '0')
+	putchar('\n')
+}
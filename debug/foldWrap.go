@@ -0,0 +1,26 @@
+package main
+
+// the folded constants wrap like int at run time
+// note: go rejects constant overflow, see debug/foldWrap/wrap.expect
+func main() {
+	a := 2147483647 + 1
+	// 2^63 wraps to the min int, and so does its negation
+	writeInt((2147483647 + 1) * (2147483647 + 1) * 2)
+	putchar('\n')
+	writeInt(a * a * 2)
+	putchar('\n')
+	writeInt(-((2147483647 + 1) * (2147483647 + 1) * 2))
+	putchar('\n')
+	writeInt(-(a * a * 2))
+	putchar('\n')
+	// the min int minus 1 wraps to the max int
+	writeInt(-((2147483647 + 1) * (2147483647 + 1) * 2) - 1)
+	putchar('\n')
+	writeInt(-(a * a * 2) - 1)
+	putchar('\n')
+	// the max int plus 1 wraps to the min int
+	writeInt(-((2147483647 + 1) * (2147483647 + 1) * 2) - 1 + 1)
+	putchar('\n')
+	writeInt(-(a * a * 2) - 1 + 1)
+	putchar('\n')
+}
@@ -0,0 +1,71 @@
+package main
+
+func putInt(n int) {
+	if n < 0 {
+		putchar('-')
+		n = -n
+	}
+	if n >= 10 {
+		putInt(n / 10)
+	}
+	putchar('0' + n%10)
+}
+
+func fill(a [][]int, v int) {
+	for i := 0; i < len(a); i++ {
+		for j := 0; j < len(a[i]); j++ {
+			a[i][j] = v + i*10 + j
+		}
+	}
+}
+
+func main() {
+	a := make([][]int, 3)
+	for i := 0; i < 3; i++ {
+		a[i] = make([]int, 4)
+	}
+	fill(a, 0)
+	// a[i] is loaded once before the j loop
+	sum := 0
+	for i := 0; i < 3; i++ {
+		for j := 0; j < 4; j++ {
+			sum += a[i][j] * a[i][j]
+		}
+	}
+	putInt(sum)
+	putchar('\n')
+	// a row is stored in the loop, so a[0] is not hoisted
+	b := make([]int, 4)
+	b[2] = 100
+	t := 0
+	for j := 0; j < 4; j++ {
+		t += a[0][2]
+		a[0] = b
+	}
+	putInt(t)
+	putchar('\n')
+	// the loop never runs, so the nil row is never loaded
+	c := make([][]int, 2)
+	k := 1
+	for j := 0; j < 0; j++ {
+		t += c[k][j]
+	}
+	// the row is only loaded in an if, so it is not hoisted
+	for j := 0; j < 4; j++ {
+		if c[k] != nil {
+			t += c[k][j]
+		}
+	}
+	putInt(t)
+	putchar('\n')
+	// the same element twice in a block, with a store between
+	a[1][1] = 5
+	x := a[1][1] + a[1][1]
+	a[1][1] = 7
+	x = x + a[1][1]
+	b[3] = 1
+	fill(a, 1)
+	x = x + a[1][1]
+	putInt(x)
+	putchar('\n')
+}
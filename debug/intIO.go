@@ -0,0 +1,27 @@
+package main
+
+// echo the ints with their sum, until a 0 is read
+func main() {
+	sum := 0
+	n := readInt()
+	for n != 0 {
+		sum += n
+		writeInt(n)
+		putchar(' ')
+		writeInt(sum)
+		putchar('\n')
+		n = readInt()
+	}
+	// the min and max of int
+	m := 1
+	for i := 0; i < 63; i++ {
+		m *= 2
+	}
+	writeInt(m)
+	putchar('\n')
+	writeInt(m - 1)
+	putchar('\n')
+	// 0 at the end of input
+	writeInt(readInt())
+	putchar('\n')
+}
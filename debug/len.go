@@ -0,0 +1,59 @@
+package main
+
+func putInt(n int) {
+	if n >= 10 {
+		putInt(n / 10)
+	}
+	putchar('0' + n%10)
+}
+
+// sum of all elements, the length is from the header
+func sum(s []int) int {
+	t := 0
+	for i := 0; i < len(s); i++ {
+		t += s[i]
+	}
+	return t
+}
+
+func newRow(n int) []int {
+	row := make([]int, n)
+	for i := 0; i < len(row); i++ {
+		row[i] = i
+	}
+	return row
+}
+
+func main() {
+	a := []int{1, 2, 3, 4}
+	putInt(len(a))
+	putchar(' ')
+	putInt(cap(a))
+	putchar(' ')
+	putInt(sum(a))
+	putchar('\n')
+	var empty []int
+	putInt(len(empty))
+	putchar(' ')
+	putInt(cap(empty))
+	putchar('\n')
+	n := len(a) + 1
+	grid := make([][]int, n)
+	for i := 0; i < len(grid); i++ {
+		grid[i] = newRow(i + 1)
+	}
+	for i := 0; i < len(grid); i++ {
+		putInt(len(grid[i]))
+		putchar(':')
+		putInt(sum(grid[i]))
+		putchar(' ')
+	}
+	putchar('\n')
+	hundred := make([]int, 100)
+	putInt(len(grid[2]) + cap(hundred))
+	putchar('\n')
+	// a local shadows the builtin
+	len := 3
+	putInt(len)
+	putchar('\n')
+}
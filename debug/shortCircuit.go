@@ -0,0 +1,36 @@
+package main
+
+func say(c int) int {
+	putchar(c)
+	return 1
+}
+
+func main() {
+	a := make([]int, 3)
+	a[0] = 5
+	a[1] = 0
+	a[2] = 7
+	// never load a[3]
+	i := 0
+	for i < 3 && a[i] != 0 {
+		i++
+	}
+	putchar('0' + i)
+	n := 3
+	if n > 5 && say('x') == 1 {
+		putchar('y')
+	}
+	if n < 5 || say('x') == 1 {
+		putchar('z')
+	}
+	if n > 5 || say('a') == 1 && say('b') == 1 {
+		putchar('c')
+	}
+	if (n == 3 || say('x') == 1) && (n == 4 || say('d') == 1) {
+		putchar('e')
+	}
+	if 1 < 2 && n == 3 || say('x') == 1 {
+		putchar('f')
+	}
+	putchar('\n')
+}
@@ -0,0 +1,59 @@
+package main
+
+func pick(a []int, b []int, first int) []int {
+	if first == 1 {
+		return a
+	} else {
+		return b
+	}
+}
+
+func sum(n int) int {
+	s := 0
+	for i := 1; i <= n; i++ {
+		if i%3 == 0 {
+			continue
+		}
+		s = s + i
+		if s > 40 {
+			break
+		}
+	}
+	return s
+	s = 0
+	return s
+}
+
+func main() {
+	x, y := 1, 2
+	for i := 0; i < 5; i++ {
+		x, y = y, x+y
+		if x > 5 {
+			x := 0
+			x++
+			putchar('0' + x%10)
+		}
+	}
+	putchar('0' + x)
+	putchar('0' + y%10)
+	var p []int
+	a := make([]int, 2)
+	a[0] = 7
+	p = a
+	for j := 0; j < 3; j++ {
+		p = pick(p, a, j%2)
+	}
+	p[1] = 8
+	putchar('0' + p[0])
+	putchar('0' + a[1])
+	putchar('0' + sum(10)%10)
+	k := 0
+	for {
+		k++
+		if k == 4 {
+			break
+		}
+	}
+	putchar('0' + k)
+	putchar('\n')
+}
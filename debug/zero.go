@@ -0,0 +1,47 @@
+package main
+
+func putInt(n int) {
+	if n >= 10 {
+		putInt(n / 10)
+	}
+	putchar('0' + n%10)
+}
+
+// sum of all elements, which are zeros if not set
+func sum(s []int) int {
+	t := 0
+	for i := 0; i < len(s); i++ {
+		t += s[i]
+	}
+	return t
+}
+
+// escapes, so from malloc or calloc
+func newRow(n int) []int {
+	row := make([]int, n)
+	return row
+}
+
+func main() {
+	// on the stack
+	small := make([]int, 5)
+	large := make([]int, 300)
+	small[1] = 7
+	putInt(sum(small) + sum(large))
+	putchar('\n')
+	// malloc with memset, then calloc
+	a := newRow(3)
+	b := newRow(1000)
+	b[999] = 1
+	putInt(sum(a) + sum(b))
+	putchar('\n')
+	// reused memory is zeroed again
+	for i := 0; i < 4; i++ {
+		c := newRow(i * 100)
+		putInt(sum(c))
+		for j := 0; j < len(c); j++ {
+			c[j] = j
+		}
+	}
+	putchar('\n')
+}
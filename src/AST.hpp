@@ -1,15 +1,22 @@
 #pragma once
 
+#include <Arena.hpp>
+#include <Error.hpp>
+#include <Intern.hpp>
+#include <JsonWriter.hpp>
+#include <cstdint>
 #include <iostream>
-#include <json.hpp>
 #include <memory>
+#include <sstream>
 #include <string>
+#include <vector>
 
-using json = nlohmann::json;
 using namespace std;
 
 extern int yydebug;
 
+class Type;
+
 /**
  * @brief the types of the AST
  */
@@ -38,6 +45,7 @@ enum class TType {
     ParenExpT,
     CallExpT,
     RuntimeFuncT,
+    BuiltinFuncT,
     MakeExpT,
     ArrayExpT,
     NilT,
@@ -50,17 +58,54 @@ enum class TType {
 };
 
 /**
- * @brief the base class of all ASTs
+ * @brief the state of parsing a file, passed to the parser, so that files
+ * can be parsed at the same time
  */
-class BaseAST {
-   protected:
+struct ParseContext {
+    /**
+     * @brief the id of the next ForStmtAST, for its labels
+     */
+    uint nextForId = 0;
     /**
-     * @brief counter for some ASTs to generate unique id
-     * @note currently used in ForStmtAST
+     * @brief the arena of the AST nodes made while parsing, which must
+     * outlive the AST
      */
-    static uint counter;
+    AstArena arena;
+    /**
+     * @brief the names in the file, interned by the lexer, which must
+     * outlive the compiler
+     */
+    Interner names;
+};
 
+/**
+ * @brief the base class of all ASTs
+ */
+class BaseAST {
    public:
+    /**
+     * @brief allocate the node from AstArena::current if any, or the heap
+     * @note no header is added to the node, delete tells where it is from
+     * by the address, see operator delete
+     */
+    static void *operator new(size_t size) {
+        auto arena = AstArena::current;
+        return arena ? arena->Alloc(size) : ::operator new(size);
+    }
+    /**
+     * @brief free the node if it is from the heap, the ones from the arena
+     * are freed with the arena all at once
+     * @note a node from an arena must be deleted while the arena is the
+     * current one, so build() keeps it current until the AST is freed
+     * @note the child lists and strings of the node are from the heap, so
+     * it is still deleted to run its destructor
+     */
+    static void operator delete(void *node) {
+        auto arena = AstArena::current;
+        if (arena == nullptr || !arena->Owns(node)) {
+            ::operator delete(node);
+        }
+    }
     /**
      * @brief the parent of the AST
      * @note need to be set when constructing the AST
@@ -76,16 +121,18 @@ class BaseAST {
      */
     virtual TType type() const = 0;
     /**
-     * @brief get the json representation of the AST
+     * @brief write the json representation of the AST
      * 
-     * @return json 
+     * @param w the writer, streaming the json as it goes
      */
-    virtual json toJson() const = 0;
+    virtual void toJson(JsonWriter &w) const = 0;
     /**
      * @brief get the string representation of the AST in json format
      */
     friend ostream &operator<<(ostream &os, const BaseAST &ast) {
-        return os << ast.toJson().dump(4);
+        JsonWriter w(os);
+        ast.toJson(w);
+        return os;
     }
     /**
      * @brief Set the Parent object 
@@ -130,6 +177,7 @@ using pvpT = vector<pAST> *;
 using pvpAST = unique_ptr<vpAST>;
 using pvStr = unique_ptr<vector<string>>;
 using pStr = unique_ptr<string>;
+using pvSym = unique_ptr<vector<Symbol>>;
 
 /**
  * @brief the base AST of all the statements
@@ -141,7 +189,19 @@ class StmtAST : public BaseAST {};
  */
 class ExpAST : public BaseAST {
    public:
-    virtual int eval() const = 0;
+    /**
+     * @brief the type of the expression, cached by Compiler::inferType
+     * @note nullptr if not inferred yet
+     */
+    const Type *inferred = nullptr;
+
+    /**
+     * @brief evaluate the expression at compile time
+     * @note in 64 bits like int in miniGo, error if not const
+     *
+     * @return int64_t - the value
+     */
+    virtual int64_t eval() const = 0;
 };
 
 /**
@@ -153,11 +213,16 @@ class VarSpecAST : public BaseAST {
    public:
     TType ty = TType::VarSpecT;
     pvStr idents;
+    vector<Symbol> syms;  // the ids of the idents
     pAST btype = nullptr;  // maybe nullptr
     pvpAST initVals = make_unique<vpAST>();
 
-    VarSpecAST(vector<string> *idents, pT btype, pvpT initVals)
-        : idents(pvStr(idents)) {
+    VarSpecAST(const Interner &names, vector<Symbol> *syms, pT btype,
+               pvpT initVals)
+        : idents(make_unique<vector<string>>()), syms(*pvSym(syms)) {
+        for (auto sym : this->syms) {
+            idents->push_back(names.Name(sym));
+        }
         if (btype == nullptr) {
             this->btype = nullptr;
         } else {
@@ -180,21 +245,26 @@ class VarSpecAST : public BaseAST {
         return btype->info();
     }
     TType type() const override { return ty; }
-    json toJson() const override {
-        json j;
-        j["type"] = "VarSpecAST";
-        j["idents"] = json::array();
+    void toJson(JsonWriter &w) const override {
+        w.BeginObject();
+        w.Field("type", "VarSpecAST");
+        w.Key("idents");
+        w.BeginArray();
         for (auto &ident : *idents) {
-            j["idents"].push_back(ident);
+            w.Value(ident);
         }
+        w.EndArray();
         if (btype != nullptr) {
-            j["btype"] = btype->toJson();
+            w.Key("btype");
+            btype->toJson(w);
         }
-        j["initVals"] = json::array();
+        w.Key("initVals");
+        w.BeginArray();
         for (auto &initVal : *initVals) {
-            j["initVals"].push_back(initVal->toJson());
+            initVal->toJson(w);
         }
-        return j;
+        w.EndArray();
+        w.EndObject();
     }
 };
 
@@ -206,13 +276,16 @@ class FuncDefAST : public BaseAST {
    public:
     TType ty = TType::FuncDefT;
     string ident;
+    Symbol sym = 0;  // the id of ident, 0 for runtime func
     pvpAST paramList;
     pAST retType;  // BType
     pAST body;
 
     FuncDefAST() = default;  // only for runtime func
-    FuncDefAST(string *ident, pvpT paramList, pT retType, pT body)
-        : ident(*pStr(ident)),
+    FuncDefAST(Symbol sym, const string &ident, pvpT paramList, pT retType,
+               pT body)
+        : ident(ident),
+          sym(sym),
           paramList(pvpAST(paramList)),
           retType(pAST(retType)),
           body(pAST(body)) {
@@ -226,7 +299,7 @@ class FuncDefAST : public BaseAST {
     virtual string getRetType() {
         if (retType == nullptr) {
             cerr << "retType is nullptr" << endl;
-            assert(false);
+            throw CompileError();
         }
         return retType->info();
     }
@@ -247,17 +320,21 @@ class FuncDefAST : public BaseAST {
         return ret;
     }
     virtual TType type() const override { return ty; }
-    virtual json toJson() const override {
-        json j;
-        j["type"] = "FuncDefAST";
-        j["ident"] = ident;
-        j["paramList"] = json::array();
+    void toJson(JsonWriter &w) const override {
+        w.BeginObject();
+        w.Field("type", "FuncDefAST");
+        w.Field("ident", ident);
+        w.Key("paramList");
+        w.BeginArray();
         for (auto &param : *paramList) {
-            j["paramList"].push_back(param->toJson());
+            param->toJson(w);
         }
-        j["retType"] = retType->toJson();
-        j["body"] = body->toJson();
-        return j;
+        w.EndArray();
+        w.Key("retType");
+        retType->toJson(w);
+        w.Key("body");
+        body->toJson(w);
+        w.EndObject();
     }
 };
 
@@ -289,15 +366,37 @@ class RuntimeFuncAST : public FuncDefAST {
         return ret;
     }
     TType type() const override { return ty; }
-    json toJson() const override {
-        json j;
-        j["type"] = "RuntimeFuncAST";
-        j["llRetType"] = llRetType;
-        j["paramTypes"] = json::array();
+    void toJson(JsonWriter &w) const override {
+        w.BeginObject();
+        w.Field("type", "RuntimeFuncAST");
+        w.Field("llRetType", llRetType);
+        w.Key("paramTypes");
+        w.BeginArray();
         for (auto &paramType : *paramTypes) {
-            j["paramTypes"].push_back(paramType);
+            w.Value(paramType);
         }
-        return j;
+        w.EndArray();
+        w.EndObject();
+    }
+};
+
+/**
+ * @brief the AST of a builtin function like len(), which is compiled inline
+ * instead of called
+ */
+class BuiltinFuncAST : public RuntimeFuncAST {
+   public:
+    BuiltinFuncAST(string ident)
+        : RuntimeFuncAST("i64", new vector<string>{"any"}) {
+        this->ident = ident;
+    }
+
+    TType type() const override { return TType::BuiltinFuncT; }
+    void toJson(JsonWriter &w) const override {
+        w.BeginObject();
+        w.Field("type", "BuiltinFuncAST");
+        w.Field("ident", ident);
+        w.EndObject();
     }
 };
 
@@ -323,25 +422,29 @@ class CompUnitAST : public BaseAST {
                     unique_ptr<FuncDefAST>((FuncDefAST *)topDef.get()));
             } else {
                 cerr << "unknown topDef type" << endl;
-                assert(false);
+                throw CompileError();
             }
         }
     }
 
     TType type() const override { return ty; }
-    json toJson() const override {
-        json j;
-        j["type"] = "CompUnitAST";
-        j["packageName"] = packageName;
-        j["Globals"] = json::array();
+    void toJson(JsonWriter &w) const override {
+        w.BeginObject();
+        w.Field("type", "CompUnitAST");
+        w.Field("packageName", packageName);
+        w.Key("Globals");
+        w.BeginArray();
         for (auto &g : Globals) {
-            j["Globals"].push_back(g->toJson());
+            g->toJson(w);
         }
-        j["Funcs"] = json::array();
+        w.EndArray();
+        w.Key("Funcs");
+        w.BeginArray();
         for (auto &f : Funcs) {
-            j["Funcs"].push_back(f->toJson());
+            f->toJson(w);
         }
-        return j;
+        w.EndArray();
+        w.EndObject();
     }
 };
 
@@ -352,22 +455,24 @@ class ParamAST : public BaseAST {
    public:
     TType ty = TType::ParamT;
     string ident;
+    Symbol sym;
     pAST t;  // BType
 
-    ParamAST(string *ident, BaseAST *t) {
-        this->ident = *pStr(ident);
+    ParamAST(Symbol sym, const string &ident, BaseAST *t) : sym(sym) {
+        this->ident = ident;
         this->t = pAST(t);
         t->setParent(this);
     }
 
     string info() const override { return t->info(); }
     TType type() const override { return ty; }
-    json toJson() const override {
-        json j;
-        j["type"] = "ParamAST";
-        j["ident"] = ident;
-        j["t"] = t->toJson();
-        return j;
+    void toJson(JsonWriter &w) const override {
+        w.BeginObject();
+        w.Field("type", "ParamAST");
+        w.Field("ident", ident);
+        w.Key("t");
+        t->toJson(w);
+        w.EndObject();
     }
 };
 
@@ -387,14 +492,16 @@ class BlockAST : public BaseAST {
     }
 
     TType type() const override { return ty; }
-    json toJson() const override {
-        json j;
-        j["type"] = "BlockAST";
-        j["stmts"] = json::array();
+    void toJson(JsonWriter &w) const override {
+        w.BeginObject();
+        w.Field("type", "BlockAST");
+        w.Key("stmts");
+        w.BeginArray();
         for (auto &stmt : *stmts) {
-            j["stmts"].push_back(stmt->toJson());
+            stmt->toJson(w);
         }
-        return j;
+        w.EndArray();
+        w.EndObject();
     }
 };
 
@@ -406,10 +513,10 @@ class EmptyStmtAST : public StmtAST {
    public:
     TType ty = TType::EmptyStmtT;
     TType type() const override { return ty; }
-    json toJson() const override {
-        json j;
-        j["type"] = "EmptyStmtAST";
-        return j;
+    void toJson(JsonWriter &w) const override {
+        w.BeginObject();
+        w.Field("type", "EmptyStmtAST");
+        w.EndObject();
     }
 };
 
@@ -436,13 +543,14 @@ class ReturnStmtAST : public StmtAST {
         return "infer";
     }
     TType type() const override { return ty; }
-    json toJson() const override {
-        json j;
-        j["type"] = "ReturnStmtAST";
+    void toJson(JsonWriter &w) const override {
+        w.BeginObject();
+        w.Field("type", "ReturnStmtAST");
         if (exp != nullptr) {
-            j["exp"] = exp->toJson();
+            w.Key("exp");
+            exp->toJson(w);
         }
-        return j;
+        w.EndObject();
     }
 };
 
@@ -460,19 +568,20 @@ class ParenExpAST : public ExpAST {
         ast->setParent(this);
     }
 
-    int eval() const override {
+    int64_t eval() const override {
         auto exp = reinterpret_cast<ExpAST *>(p.get());
         return exp->eval();
     }
     BaseAST *copy() const override { return new ParenExpAST(p->copy()); }
     TType type() const override { return ty; }
-    json toJson() const override {
-        json j;
-        j["type"] = "ParenExpAST";
+    void toJson(JsonWriter &w) const override {
+        w.BeginObject();
+        w.Field("type", "ParenExpAST");
         if (p != nullptr) {
-            j["p"] = p->toJson();
+            w.Key("p");
+            p->toJson(w);
         }
-        return j;
+        w.EndObject();
     }
 };
 
@@ -482,18 +591,18 @@ class ParenExpAST : public ExpAST {
 class NumberAST : public ExpAST {
    public:
     TType ty = TType::NumberT;
-    int num;
+    int64_t num;
 
-    NumberAST(int n) { num = n; }
+    NumberAST(int64_t n) { num = n; }
 
-    int eval() const override { return num; }
+    int64_t eval() const override { return num; }
     BaseAST *copy() const override { return new NumberAST(num); }
     TType type() const override { return ty; }
-    json toJson() const override {
-        json j;
-        j["type"] = "NumberAST";
-        j["num"] = num;
-        return j;
+    void toJson(JsonWriter &w) const override {
+        w.BeginObject();
+        w.Field("type", "NumberAST");
+        w.Field("num", num);
+        w.EndObject();
     }
 };
 
@@ -518,7 +627,7 @@ class BTypeAST : public BaseAST {
             return "void";
         } else {
             cerr << "BTypeAST error: unknown element type" << endl;
-            assert(false);
+            throw CompileError();
         }
         if (dims != nullptr && !dims->empty()) {
             for (auto &dim : *dims) {
@@ -541,17 +650,19 @@ class BTypeAST : public BaseAST {
         return ret;
     }
     TType type() const override { return ty; }
-    json toJson() const override {
-        json j;
-        j["type"] = "BTypeAST";
-        j["elementType"] = elementType;
+    void toJson(JsonWriter &w) const override {
+        w.BeginObject();
+        w.Field("type", "BTypeAST");
+        w.Field("elementType", elementType);
         if (dims != nullptr && !dims->empty()) {
-            j["dims"] = json::array();
+            w.Key("dims");
+            w.BeginArray();
             for (auto &dim : *dims) {
-                j["dims"].push_back(dim);
+                w.Value(dim);
             }
+            w.EndArray();
         }
-        return j;
+        w.EndObject();
     }
 };
 
@@ -573,32 +684,33 @@ class UnaryExpAST : public ExpAST {
         p = pAST(ast);
     }
 
-    int eval() const override {
+    int64_t eval() const override {
         auto exp = reinterpret_cast<ExpAST *>(p.get());
-        int val = exp->eval();
+        int64_t val = exp->eval();
         switch (op) {
             case '+':
                 return val;
             case '-':
-                return -val;
+                // wraps on overflow like the emitted sub, not UB
+                return int64_t(-uint64_t(val));
             case '!':
                 return !val;
             default:
                 cerr << "error: unknown unary operator" << endl;
-                assert(false);
-                return -1;
+                throw CompileError();
         }
     }
     BaseAST *copy() const override { return new UnaryExpAST(op, p->copy()); }
     TType type() const override { return ty; }
-    json toJson() const override {
-        json j;
-        j["type"] = "UnaryExpAST";
-        j["op"] = string(1, op);
+    void toJson(JsonWriter &w) const override {
+        w.BeginObject();
+        w.Field("type", "UnaryExpAST");
+        w.Field("op", string(1, op));
         if (p != nullptr) {
-            j["p"] = p->toJson();
+            w.Key("p");
+            p->toJson(w);
         }
-        return j;
+        w.EndObject();
     }
 };
 
@@ -610,10 +722,12 @@ class CallExpAST : public ExpAST {
    public:
     TType ty = TType::CallExpT;
     string funcName = "";
+    Symbol sym;  // the id of funcName
     pvpAST argList = nullptr;
 
-    CallExpAST(string *_funcName, vpAST *_argList) {
-        funcName = *unique_ptr<string>(_funcName);
+    CallExpAST(Symbol sym, const string &_funcName, vpAST *_argList)
+        : sym(sym) {
+        funcName = _funcName;
         argList = pvpAST(_argList);
         // set parent
         for (auto &arg : *argList) {
@@ -621,32 +735,33 @@ class CallExpAST : public ExpAST {
         }
     }
 
-    int eval() const override {
+    int64_t eval() const override {
         cerr << "error: call expression is not const" << endl;
-        assert(false);
-        return -1;
+        throw CompileError();
     }
     BaseAST *copy() const override {
         auto newArgList = new vector<pAST>();
         for (auto &arg : *argList) {
             newArgList->push_back(pAST(arg->copy()));
         }
-        return new CallExpAST(new string(funcName), newArgList);
+        return new CallExpAST(sym, funcName, newArgList);
     }
     TType type() const override { return ty; }
-    json toJson() const override {
-        json j;
-        j["type"] = "CallExpAST";
+    void toJson(JsonWriter &w) const override {
+        w.BeginObject();
+        w.Field("type", "CallExpAST");
         if (funcName != "") {
-            j["funcName"] = funcName;
+            w.Field("funcName", funcName);
         }
         if (argList != nullptr) {
-            j["argList"] = json::array();
+            w.Key("argList");
+            w.BeginArray();
             for (auto &arg : *argList) {
-                j["argList"].push_back(arg->toJson());
+                arg->toJson(w);
             }
+            w.EndArray();
         }
-        return j;
+        w.EndObject();
     }
 };
 
@@ -665,8 +780,7 @@ class ForStmtAST : public StmtAST {
     pAST body;  // cannot be nullptr
 
     ForStmtAST() = delete;
-    ForStmtAST(pT _init, pT _cond, pT _post, pT _body) {
-        id = BaseAST::counter++;
+    ForStmtAST(uint id, pT _init, pT _cond, pT _post, pT _body) : id(id) {
         if (_init == nullptr)
             init = make_unique<EmptyStmtAST>();
         else
@@ -697,35 +811,39 @@ class ForStmtAST : public StmtAST {
     }
 
     TType type() const override { return ty; }
-    json toJson() const override {
+    void toJson(JsonWriter &w) const override {
         if (yydebug) cout << "ForStmtAST::toJson" << endl;
-        json j;
-        j["type"] = "ForStmtAST";
+        w.BeginObject();
+        w.Field("type", "ForStmtAST");
         if (init != nullptr) {
-            j["init"] = init->toJson();
+            w.Key("init");
+            init->toJson(w);
         } else {
             cerr << "error: init is nullptr" << endl;
-            assert(false);
+            throw CompileError();
         }
         if (cond != nullptr) {
-            j["cond"] = cond->toJson();
+            w.Key("cond");
+            cond->toJson(w);
         } else {
             cerr << "error: cond is nullptr" << endl;
-            assert(false);
+            throw CompileError();
         }
         if (post != nullptr) {
-            j["post"] = post->toJson();
+            w.Key("post");
+            post->toJson(w);
         } else {
             cerr << "error: post is nullptr" << endl;
-            assert(false);
+            throw CompileError();
         }
         if (body != nullptr) {
-            j["body"] = body->toJson();
+            w.Key("body");
+            body->toJson(w);
         } else {
             cerr << "error: body is nullptr" << endl;
-            assert(false);
+            throw CompileError();
         }
-        return j;
+        w.EndObject();
     }
 };
 
@@ -770,45 +888,45 @@ class BinExpAST : public ExpAST {
             op = Op::MOD;
         } else {
             cerr << "BinExpAST: unknown char op" << endl;
-            assert(false);
+            throw CompileError();
         }
         ast1->setParent(this);
         ast2->setParent(this);
         left = pAST(ast1);
         right = pAST(ast2);
     }
-    BinExpAST(string *_op, BaseAST *ast1, BaseAST *ast2) {
+    BinExpAST(const string &_op, BaseAST *ast1, BaseAST *ast2) {
         // assign op according to == != < <= > >= && ||
-        opStr = *_op;
-        if (*_op == "==") {
+        opStr = _op;
+        if (_op == "==") {
             op = Op::EQ;
-        } else if (*_op == "!=") {
+        } else if (_op == "!=") {
             op = Op::NE;
-        } else if (*_op == "<") {
+        } else if (_op == "<") {
             op = Op::LT;
-        } else if (*_op == "<=") {
+        } else if (_op == "<=") {
             op = Op::LE;
-        } else if (*_op == ">") {
+        } else if (_op == ">") {
             op = Op::GT;
-        } else if (*_op == ">=") {
+        } else if (_op == ">=") {
             op = Op::GE;
-        } else if (*_op == "&&") {
+        } else if (_op == "&&") {
             op = Op::AND;
-        } else if (*_op == "||") {
+        } else if (_op == "||") {
             op = Op::OR;
-        } else if (*_op == "+") {
+        } else if (_op == "+") {
             op = Op::ADD;
-        } else if (*_op == "-") {
+        } else if (_op == "-") {
             op = Op::SUB;
-        } else if (*_op == "*") {
+        } else if (_op == "*") {
             op = Op::MUL;
-        } else if (*_op == "/") {
+        } else if (_op == "/") {
             op = Op::DIV;
-        } else if (*_op == "%") {
+        } else if (_op == "%") {
             op = Op::MOD;
         } else {
             cerr << "BinExpAST: unknown string op" << endl;
-            assert(false);
+            throw CompileError();
         }
         ast1->setParent(this);
         ast2->setParent(this);
@@ -816,15 +934,17 @@ class BinExpAST : public ExpAST {
         right = pAST(ast2);
     }
 
-    int eval() const override {
+    int64_t eval() const override {
         auto lExp = reinterpret_cast<const ExpAST *>(left.get());
         auto rExp = reinterpret_cast<const ExpAST *>(right.get());
+        // add, sub and mul are done unsigned, so that they wrap on overflow
+        // like the emitted IR, which is UB for int64_t
         if (op == Op::ADD) {
-            return lExp->eval() + rExp->eval();
+            return int64_t(uint64_t(lExp->eval()) + uint64_t(rExp->eval()));
         } else if (op == Op::SUB) {
-            return lExp->eval() - rExp->eval();
+            return int64_t(uint64_t(lExp->eval()) - uint64_t(rExp->eval()));
         } else if (op == Op::MUL) {
-            return lExp->eval() * rExp->eval();
+            return int64_t(uint64_t(lExp->eval()) * uint64_t(rExp->eval()));
         } else if (op == Op::DIV) {
             return lExp->eval() / rExp->eval();
         } else if (op == Op::MOD) {
@@ -847,21 +967,24 @@ class BinExpAST : public ExpAST {
             return lExp->eval() || rExp->eval();
         } else {
             cerr << "error: unknown op" << endl;
-            assert(false);
-            return -1;
+            throw CompileError();
         }
     }
     BaseAST *copy() const override {
-        return new BinExpAST(new string(opStr), left->copy(), right->copy());
+        return new BinExpAST(opStr, left->copy(), right->copy());
     }
     TType type() const override { return ty; }
-    json toJson() const override {
-        json j;
-        j["type"] = "BinaryExpAST";
-        j["op"] = opStr;
-        if (left != nullptr) j["left"] = left->toJson();
-        j["right"] = right->toJson();
-        return j;
+    void toJson(JsonWriter &w) const override {
+        w.BeginObject();
+        w.Field("type", "BinaryExpAST");
+        w.Field("op", opStr);
+        if (left != nullptr) {
+            w.Key("left");
+            left->toJson(w);
+        }
+        w.Key("right");
+        right->toJson(w);
+        w.EndObject();
     }
 };
 
@@ -900,23 +1023,27 @@ class ShortVarDeclAST : public StmtAST {
     }
 
     TType type() const override { return ty; }
-    json toJson() const override {
-        json j;
-        j["type"] = "ShortVarDecl";
-        j["isDefine"] = isDefine;
+    void toJson(JsonWriter &w) const override {
+        w.BeginObject();
+        w.Field("type", "ShortVarDecl");
+        w.Field("isDefine", isDefine);
         if (targets != nullptr) {
-            j["targets"] = json::array();
+            w.Key("targets");
+            w.BeginArray();
             for (auto &tar : *targets) {
-                j["targets"].push_back(tar->toJson());
+                tar->toJson(w);
             }
+            w.EndArray();
         }
         if (initVals != nullptr) {
-            j["initVals"] = json::array();
+            w.Key("initVals");
+            w.BeginArray();
             for (auto &initVal : *initVals) {
-                j["initVals"].push_back(initVal->toJson());
+                initVal->toJson(w);
             }
+            w.EndArray();
         }
-        return j;
+        w.EndObject();
     }
 };
 
@@ -928,13 +1055,15 @@ class LValAST : public ExpAST {
    public:
     TType ty = TType::LValT;
     string ident;
+    Symbol sym = 0;  // the id of ident
     pvpAST indexList = nullptr;  // cannot be nullptr
     // only generated by := stmt or var spec
     string typeInfo = "";
     // TODO support const
     // bool isConst = false;
 
-    LValAST(string *_ident, pvpT _indexList) : ident(*pStr(_ident)) {
+    LValAST(Symbol sym, const string &_ident, pvpT _indexList)
+        : ident(_ident), sym(sym) {
         if (_indexList == nullptr) {
             indexList = make_unique<vpAST>();
         } else {
@@ -944,15 +1073,16 @@ class LValAST : public ExpAST {
             indexList = pvpAST(_indexList);
         }
     }
-    LValAST(string ident, pvpT list, string typeInfo)
-        : ident(ident), typeInfo(typeInfo) {
+    LValAST(Symbol sym, string ident, pvpT list, string typeInfo)
+        : ident(ident), sym(sym), typeInfo(typeInfo) {
         indexList = pvpAST(list);
         for (auto &index : *indexList) {
             index->setParent(this);
         }
     }
     // store typeInfo as node in obj
-    LValAST(string ident, string typeInfo) : ident(ident), typeInfo(typeInfo) {
+    LValAST(Symbol sym, string ident, string typeInfo)
+        : ident(ident), sym(sym), typeInfo(typeInfo) {
         indexList = make_unique<vpAST>();
     }
 
@@ -969,14 +1099,13 @@ class LValAST : public ExpAST {
         for (auto &index : *indexList) {
             list->push_back(pAST(index->copy()));
         }
-        return new LValAST(ident, list, typeInfo);
+        return new LValAST(sym, ident, list, typeInfo);
     }
 
-    int eval() const override {
+    int64_t eval() const override {
         // TODO support const var
         cerr << "error: lval is not const" << endl;
-        assert(false);
-        return -1;
+        throw CompileError();
     }
     // type for the ident, generated by := stmt
     // indexList not considered
@@ -984,27 +1113,29 @@ class LValAST : public ExpAST {
         if (typeInfo == "") {
             cerr << "error: not var defined with :=" << endl;
             cerr << "please use inferType instead" << endl;
-            assert(false);
+            throw CompileError();
         }
         return typeInfo;
     }
     TType type() const override { return ty; }
-    json toJson() const override {
-        json j;
-        j["type"] = "LValAST";
-        j["ident"] = ident;
+    void toJson(JsonWriter &w) const override {
+        w.BeginObject();
+        w.Field("type", "LValAST");
+        w.Field("ident", ident);
         if (indexList != nullptr) {
             if (indexList->size() > 0) {
-                j["indexList"] = json::array();
+                w.Key("indexList");
+                w.BeginArray();
                 for (auto &index : *indexList) {
-                    j["indexList"].push_back(index->toJson());
+                    index->toJson(w);
                 }
+                w.EndArray();
             }
         }
         if (typeInfo != "") {
-            j["typeInfo"] = typeInfo;
+            w.Field("typeInfo", typeInfo);
         }
-        return j;
+        w.EndObject();
     }
 };
 
@@ -1044,20 +1175,24 @@ class IfStmtAST : public StmtAST {
     }
 
     TType type() const override { return ty; }
-    json toJson() const override {
+    void toJson(JsonWriter &w) const override {
         if (yydebug) cout << "IfStmtAST::toJson" << endl;
-        json j;
-        j["type"] = "IfStmtAST";
-        j["t"] = t;
+        w.BeginObject();
+        w.Field("type", "IfStmtAST");
+        w.Field("t", t);
         if (init != nullptr) {
-            j["init"] = init->toJson();
+            w.Key("init");
+            init->toJson(w);
         }
-        j["cond"] = cond->toJson();
-        j["body"] = body->toJson();
+        w.Key("cond");
+        cond->toJson(w);
+        w.Key("body");
+        body->toJson(w);
         if (elseBlockStmt != nullptr) {
-            j["elseBlockStmt"] = elseBlockStmt->toJson();
+            w.Key("elseBlockStmt");
+            elseBlockStmt->toJson(w);
         }
-        return j;
+        w.EndObject();
     }
 };
 
@@ -1073,11 +1208,12 @@ class ExpStmtAST : public StmtAST {
     ExpStmtAST(pT exp) : exp(pAST(exp)) { exp->setParent(this); }
 
     TType type() const override { return ty; }
-    json toJson() const override {
-        json j;
-        j["type"] = "ExpStmtAST";
-        j["exp"] = exp->toJson();
-        return j;
+    void toJson(JsonWriter &w) const override {
+        w.BeginObject();
+        w.Field("type", "ExpStmtAST");
+        w.Key("exp");
+        exp->toJson(w);
+        w.EndObject();
     }
 };
 
@@ -1091,23 +1227,17 @@ class BranchStmtAST : public StmtAST {
     enum Type { Break, Continue, Goto } t;
     string ident = "";
 
-    BranchStmtAST(Type _t, string *_ident = nullptr) : t(_t) {
-        if (_ident != nullptr) {
-            ident = *pStr(_ident);
-        } else {
-            ident = "";
-        }
-    }
+    BranchStmtAST(Type _t, const string &_ident = "") : t(_t), ident(_ident) {}
 
     TType type() const override { return ty; }
-    json toJson() const override {
-        json j;
-        j["type"] = "BranchStmtAST";
-        j["t"] = t;
+    void toJson(JsonWriter &w) const override {
+        w.BeginObject();
+        w.Field("type", "BranchStmtAST");
+        w.Field("t", t);
         if (t == Type::Goto) {
-            j["ident"] = ident;
+            w.Field("ident", ident);
         }
-        return j;
+        w.EndObject();
     }
 };
 
@@ -1126,12 +1256,13 @@ class IncDecStmtAST : public StmtAST {
     }
 
     TType type() const override { return ty; }
-    json toJson() const override {
-        json j;
-        j["type"] = "IncDecStmtAST";
-        j["target"] = target->toJson();
-        j["isInc"] = isInc;
-        return j;
+    void toJson(JsonWriter &w) const override {
+        w.BeginObject();
+        w.Field("type", "IncDecStmtAST");
+        w.Key("target");
+        target->toJson(w);
+        w.Field("isInc", isInc);
+        w.EndObject();
     }
 };
 
@@ -1145,6 +1276,8 @@ class MakeExpAST : public ExpAST {
     TType ty = TType::MakeExpT;
     pAST t;    // BType
     pAST len;  // Exp
+    // never escapes the function, set by EscapeAnalysis
+    bool onStack = false;
 
     MakeExpAST(BaseAST *tt, BaseAST *exp) {
         t = pAST(tt);
@@ -1154,24 +1287,25 @@ class MakeExpAST : public ExpAST {
         len->setParent(this);
     }
 
-    int eval() const override {
+    int64_t eval() const override {
         cerr << "eval: make exp cannot be const" << endl;
-        assert(false);
-        return -1;
+        throw CompileError();
     }
     BaseAST *copy() const override {
         return new MakeExpAST(t->copy(), len->copy());
     }
     string info() const override { return t->info(); }
     TType type() const override { return ty; }
-    json toJson() const override {
-        json j;
-        j["type"] = "MakeExpAST";
-        j["t"] = t->toJson();
+    void toJson(JsonWriter &w) const override {
+        w.BeginObject();
+        w.Field("type", "MakeExpAST");
+        w.Key("t");
+        t->toJson(w);
         if (len != nullptr) {
-            j["len"] = len->toJson();
+            w.Key("len");
+            len->toJson(w);
         }
-        return j;
+        w.EndObject();
     }
 };
 
@@ -1185,6 +1319,8 @@ class ArrayExpAST : public ExpAST {
     TType ty = TType::ArrayExpT;
     pAST t;              // BType, array type like []int
     pvpAST initValList;  // list of initVal, cannot be nullptr
+    // never escapes the function, set by EscapeAnalysis
+    bool onStack = false;
 
     ArrayExpAST() = delete;
     ArrayExpAST(pT _t, pvpT list) {
@@ -1197,10 +1333,9 @@ class ArrayExpAST : public ExpAST {
         }
     }
 
-    int eval() const override {
+    int64_t eval() const override {
         cerr << "eval: array exp cannot be int" << endl;
-        assert(false);
-        return -1;
+        throw CompileError();
     }
     BaseAST *copy() const override {
         auto _t = t->copy();
@@ -1213,17 +1348,20 @@ class ArrayExpAST : public ExpAST {
     }
     string info() const override { return t->info(); }
     TType type() const override { return ty; }
-    json toJson() const override {
-        json j;
-        j["type"] = "ArrayExpAST";
-        j["t"] = t->toJson();
+    void toJson(JsonWriter &w) const override {
+        w.BeginObject();
+        w.Field("type", "ArrayExpAST");
+        w.Key("t");
+        t->toJson(w);
         if (initValList != nullptr) {
-            j["initValList"] = json::array();
+            w.Key("initValList");
+            w.BeginArray();
             for (auto &exp : *initValList) {
-                j["initValList"].push_back(exp->toJson());
+                exp->toJson(w);
             }
+            w.EndArray();
         }
-        return j;
+        w.EndObject();
     }
 };
 
@@ -1235,18 +1373,17 @@ class NilAST : public ExpAST {
    public:
     TType ty = TType::NilT;
 
-    int eval() const override {
+    int64_t eval() const override {
         // TODO maybe enable eval ptr
         cerr << "eval: nil cannot be int" << endl;
-        assert(false);
-        return -1;
+        throw CompileError();
     }
     BaseAST *copy() const override { return new NilAST(); }
     string info() const override { return "nil"; }  // matches any pointer
     TType type() const override { return ty; }
-    json toJson() const override {
-        json j;
-        j["type"] = "NilAST";
-        return j;
+    void toJson(JsonWriter &w) const override {
+        w.BeginObject();
+        w.Field("type", "NilAST");
+        w.EndObject();
     }
 };
\ No newline at end of file
@@ -0,0 +1,104 @@
+#pragma once
+
+/**
+ * @file Arena.hpp
+ * @author Asilvorcarp (asilvorcarp@qq.com)
+ * @brief the arena the AST nodes of a parse are allocated from
+ * @version 2.0
+ * @date 2023-06-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief a bump allocator in chunks, all freed at once when it is destroyed
+ * @note the memory is not freed one by one, so the objects in it must be
+ * destroyed before the arena
+ * @note only the nodes are allocated from it, the vectors and strings in
+ * them are still from the heap, so the nodes are still destroyed one by one,
+ * and only the malloc of each node is saved
+ */
+class AstArena {
+    vector<unique_ptr<char[]>> chunks;
+    /**
+     * @brief the [begin, end) of the chunks, sorted, for Owns()
+     */
+    vector<pair<char*, char*>> ranges;
+    char* pos = nullptr;
+    char* end = nullptr;
+
+    static constexpr size_t chunkSize = 64 * 1024;
+    static constexpr size_t align = 16;
+
+   public:
+    /**
+     * @brief the arena to allocate the AST nodes of this thread from, or
+     * nullptr for the heap, see BaseAST::operator new
+     */
+    static inline thread_local AstArena* current = nullptr;
+
+    /**
+     * @brief make the arena the current one of this thread until the end of
+     * the scope
+     */
+    class Use {
+        AstArena* last;
+
+       public:
+        Use(AstArena& arena) : last(current) { current = &arena; }
+        ~Use() { current = last; }
+        Use(const Use&) = delete;
+        Use& operator=(const Use&) = delete;
+    };
+
+    AstArena() = default;
+    AstArena(const AstArena&) = delete;
+    AstArena& operator=(const AstArena&) = delete;
+
+    /**
+     * @brief allocate the memory, aligned to 16 bytes
+     *
+     * @param size the size in bytes
+     * @return void* - the memory
+     */
+    void* Alloc(size_t size) {
+        size = (size + align - 1) & ~(align - 1);
+        if (size > size_t(end - pos)) {
+            // a large one gets a chunk of its own
+            auto n = max(size, chunkSize);
+            chunks.emplace_back(new char[n]);
+            pos = chunks.back().get();
+            end = pos + n;
+            ranges.insert(upper_bound(ranges.begin(), ranges.end(),
+                                      make_pair(pos, end)),
+                          {pos, end});
+        }
+        auto p = pos;
+        pos += size;
+        return p;
+    }
+
+    /**
+     * @brief whether the memory is allocated from the arena
+     *
+     * @param p the memory
+     * @return true if it is in a chunk of the arena
+     */
+    bool Owns(const void* p) const {
+        auto c = static_cast<const char*>(p);
+        // the last chunk starting at or before p
+        auto it = upper_bound(
+            ranges.begin(), ranges.end(), c,
+            [](const char* c, const pair<char*, char*>& r) { return c < r.first; });
+        return it != ranges.begin() && c < prev(it)->second;
+    }
+};
@@ -0,0 +1,547 @@
+#pragma once
+
+/**
+ * @file AstFile.hpp
+ * @author Asilvorcarp (asilvorcarp@qq.com)
+ * @brief the binary file of a parsed AST, reloaded without parsing again
+ * @version 2.0
+ * @date 2023-06-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <AST.hpp>
+
+using namespace std;
+
+/**
+ * @brief the format of the binary AST file
+ * @note all ints are little-endian, and the file is read in place, so it can
+ * be mapped with mmap, see SourceFile
+ * @note the layout is
+ * - the header: the magic "MGAS", u32 version, u32 number of strings
+ * - the strings: u32 length and the bytes of each
+ * - the CompUnitAST as a node
+ * @note a node is u8 TType, u32 size of its fields in bytes, then the
+ * fields, where a string is its u32 index in the strings, a list is a u32
+ * count and the items, and an optional node is u8 0 or 1 and the node
+ */
+struct AstFormat {
+    static constexpr char magic[4] = {'M', 'G', 'A', 'S'};
+    /**
+     * @brief the version of the format, changed with any change of a node
+     */
+    static constexpr uint32_t version = 1;
+    static constexpr size_t headerSize = 12;
+};
+
+/**
+ * @brief write the AST of a file to the binary format
+ * @note the names are interned again in the order they are written, so the
+ * strings of the file are only those used by the AST
+ */
+class AstWriter {
+    Interner strings;
+    uint32_t nStrings = 0;
+    string table;
+    string nodes;
+
+    static void putU32(string& out, uint32_t v) {
+        char b[4];
+        for (int i = 0; i < 4; i++) {
+            b[i] = char(v >> (8 * i));
+        }
+        out.append(b, 4);
+    }
+    static void putI64(string& out, int64_t v) {
+        char b[8];
+        for (int i = 0; i < 8; i++) {
+            b[i] = char(uint64_t(v) >> (8 * i));
+        }
+        out.append(b, 8);
+    }
+    void u8(uint8_t v) { nodes.push_back(char(v)); }
+    void u32(uint32_t v) { putU32(nodes, v); }
+    void str(const string& s) {
+        auto id = strings.Intern(s);
+        if (id > nStrings) {
+            // new, so append it to the table, the ids of the file are from 0
+            nStrings = id;
+            putU32(table, s.size());
+            table += s;
+        }
+        u32(id - 1);
+    }
+    void list(const vpAST& l) {
+        u32(l.size());
+        for (auto& n : l) {
+            node(n.get());
+        }
+    }
+    void optional(const BaseAST* n) {
+        u8(n != nullptr);
+        if (n != nullptr) {
+            node(n);
+        }
+    }
+
+    void node(const BaseAST* ast) {
+        u8(uint8_t(ast->type()));
+        // the size is known after the fields
+        auto sizeAt = nodes.size();
+        u32(0);
+        switch (ast->type()) {
+            case TType::CompUnitT: {
+                auto n = reinterpret_cast<const CompUnitAST*>(ast);
+                str(n->packageName);
+                u32(n->Globals.size());
+                for (auto& g : n->Globals) {
+                    node(g.get());
+                }
+                u32(n->Funcs.size());
+                for (auto& f : n->Funcs) {
+                    node(f.get());
+                }
+                break;
+            }
+            case TType::FuncDefT: {
+                auto n = reinterpret_cast<const FuncDefAST*>(ast);
+                str(n->ident);
+                list(*n->paramList);
+                node(n->retType.get());
+                node(n->body.get());
+                break;
+            }
+            case TType::ParamT: {
+                auto n = reinterpret_cast<const ParamAST*>(ast);
+                str(n->ident);
+                node(n->t.get());
+                break;
+            }
+            case TType::BlockT:
+                list(*reinterpret_cast<const BlockAST*>(ast)->stmts);
+                break;
+            case TType::BTypeT: {
+                auto n = reinterpret_cast<const BTypeAST*>(ast);
+                str(n->elementType);
+                u32(n->dims == nullptr ? 0 : n->dims->size());
+                if (n->dims != nullptr) {
+                    for (auto dim : *n->dims) {
+                        u32(uint32_t(dim));
+                    }
+                }
+                break;
+            }
+            case TType::VarSpecT: {
+                auto n = reinterpret_cast<const VarSpecAST*>(ast);
+                u32(n->idents->size());
+                for (auto& ident : *n->idents) {
+                    str(ident);
+                }
+                optional(n->btype.get());
+                list(*n->initVals);
+                break;
+            }
+            case TType::EmptyStmtT:
+            case TType::NilT:
+                break;
+            case TType::ExpStmtT:
+                node(reinterpret_cast<const ExpStmtAST*>(ast)->exp.get());
+                break;
+            case TType::ReturnStmtT:
+                optional(reinterpret_cast<const ReturnStmtAST*>(ast)->exp.get());
+                break;
+            case TType::ForStmtT: {
+                auto n = reinterpret_cast<const ForStmtAST*>(ast);
+                u32(n->id);
+                node(n->init.get());
+                node(n->cond.get());
+                node(n->post.get());
+                node(n->body.get());
+                break;
+            }
+            case TType::BranchStmtT: {
+                auto n = reinterpret_cast<const BranchStmtAST*>(ast);
+                u8(n->t);
+                str(n->ident);
+                break;
+            }
+            case TType::IncDecStmtT: {
+                auto n = reinterpret_cast<const IncDecStmtAST*>(ast);
+                node(n->target.get());
+                u8(n->isInc);
+                break;
+            }
+            case TType::ShortVarDeclT: {
+                // a += b is saved as a = a + b, which it is parsed to
+                auto n = reinterpret_cast<const ShortVarDeclAST*>(ast);
+                u8(n->isDefine);
+                list(*n->targets);
+                list(*n->initVals);
+                break;
+            }
+            case TType::IfStmtT: {
+                auto n = reinterpret_cast<const IfStmtAST*>(ast);
+                u8(n->t);
+                optional(n->init.get());
+                node(n->cond.get());
+                node(n->body.get());
+                optional(n->elseBlockStmt.get());
+                break;
+            }
+            case TType::LValT: {
+                auto n = reinterpret_cast<const LValAST*>(ast);
+                str(n->ident);
+                list(*n->indexList);
+                str(n->typeInfo);
+                break;
+            }
+            case TType::NumberT:
+                putI64(nodes, reinterpret_cast<const NumberAST*>(ast)->num);
+                break;
+            case TType::BinExpT: {
+                auto n = reinterpret_cast<const BinExpAST*>(ast);
+                str(n->opStr);
+                node(n->left.get());
+                node(n->right.get());
+                break;
+            }
+            case TType::UnaryExpT: {
+                auto n = reinterpret_cast<const UnaryExpAST*>(ast);
+                u8(n->op);
+                node(n->p.get());
+                break;
+            }
+            case TType::ParenExpT:
+                node(reinterpret_cast<const ParenExpAST*>(ast)->p.get());
+                break;
+            case TType::CallExpT: {
+                auto n = reinterpret_cast<const CallExpAST*>(ast);
+                str(n->funcName);
+                list(*n->argList);
+                break;
+            }
+            case TType::MakeExpT: {
+                auto n = reinterpret_cast<const MakeExpAST*>(ast);
+                node(n->t.get());
+                node(n->len.get());
+                break;
+            }
+            case TType::ArrayExpT: {
+                auto n = reinterpret_cast<const ArrayExpAST*>(ast);
+                node(n->t.get());
+                list(*n->initValList);
+                break;
+            }
+            default:
+                cerr << "AstWriter: unknown node type " << int(ast->type())
+                     << endl;
+                throw CompileError();
+        }
+        uint32_t size = nodes.size() - sizeAt - 4;
+        for (int i = 0; i < 4; i++) {
+            nodes[sizeAt + i] = char(size >> (8 * i));
+        }
+    }
+
+   public:
+    /**
+     * @brief write the AST to the binary format
+     *
+     * @param unit the CompUnitAST (file), as parsed
+     * @return string - the bytes of the file
+     */
+    string Write(const CompUnitAST* unit) {
+        node(unit);
+        string out(AstFormat::magic, 4);
+        putU32(out, AstFormat::version);
+        putU32(out, nStrings);
+        out += table;
+        out += nodes;
+        return out;
+    }
+};
+
+/**
+ * @brief read the AST of a file from the binary format, as if it is parsed
+ * @note the nodes are allocated like the ones from the parser, and the
+ * names are interned into the ParseContext
+ */
+class AstReader {
+    string_view data;
+    size_t pos = 0;
+    ParseContext& ctx;
+    /**
+     * @brief the Symbol in ctx.names of each string of the file
+     */
+    vector<Symbol> syms;
+
+    void need(size_t n) {
+        if (n > data.size() - pos) {
+            cerr << "AstReader: truncated at " << pos << endl;
+            throw CompileError();
+        }
+    }
+    uint8_t u8() {
+        need(1);
+        return uint8_t(data[pos++]);
+    }
+    uint32_t u32() {
+        need(4);
+        uint32_t v = 0;
+        for (int i = 0; i < 4; i++) {
+            v |= uint32_t(uint8_t(data[pos + i])) << (8 * i);
+        }
+        pos += 4;
+        return v;
+    }
+    int64_t i64() {
+        need(8);
+        uint64_t v = 0;
+        for (int i = 0; i < 8; i++) {
+            v |= uint64_t(uint8_t(data[pos + i])) << (8 * i);
+        }
+        pos += 8;
+        return int64_t(v);
+    }
+    Symbol sym() {
+        auto id = u32();
+        if (id >= syms.size()) {
+            cerr << "AstReader: bad string " << id << endl;
+            throw CompileError();
+        }
+        return syms[id];
+    }
+    const string& str() { return ctx.names.Name(sym()); }
+    pvpT list() {
+        auto l = new vpAST();
+        for (auto n = u32(); n > 0; n--) {
+            l->push_back(pAST(node()));
+        }
+        return l;
+    }
+    pT optional() { return u8() ? node() : nullptr; }
+
+    pT node() {
+        auto type = TType(u8());
+        auto size = u32();
+        need(size);
+        auto end = pos + size;
+        pT ret = nullptr;
+        switch (type) {
+            case TType::CompUnitT: {
+                auto n = new CompUnitAST();
+                n->packageName = str();
+                for (auto k = u32(); k > 0; k--) {
+                    auto g = node();
+                    g->setParent(n);
+                    n->Globals.push_back(
+                        unique_ptr<VarSpecAST>(reinterpret_cast<VarSpecAST*>(g)));
+                }
+                for (auto k = u32(); k > 0; k--) {
+                    auto f = node();
+                    f->setParent(n);
+                    n->Funcs.push_back(
+                        unique_ptr<FuncDefAST>(reinterpret_cast<FuncDefAST*>(f)));
+                }
+                ret = n;
+                break;
+            }
+            case TType::FuncDefT: {
+                auto s = sym();
+                auto params = list();
+                auto retType = node();
+                auto body = node();
+                ret = new FuncDefAST(s, ctx.names.Name(s), params, retType,
+                                     body);
+                break;
+            }
+            case TType::ParamT: {
+                auto s = sym();
+                ret = new ParamAST(s, ctx.names.Name(s), node());
+                break;
+            }
+            case TType::BlockT:
+                ret = new BlockAST(list());
+                break;
+            case TType::BTypeT: {
+                auto n = new BTypeAST();
+                n->elementType = str();
+                auto k = u32();
+                if (k > 0) {
+                    n->dims = make_unique<vector<int>>();
+                    for (; k > 0; k--) {
+                        n->dims->push_back(int(u32()));
+                    }
+                }
+                ret = n;
+                break;
+            }
+            case TType::VarSpecT: {
+                auto s = new vector<Symbol>();
+                for (auto k = u32(); k > 0; k--) {
+                    s->push_back(sym());
+                }
+                auto btype = optional();
+                auto initVals = list();
+                ret = new VarSpecAST(ctx.names, s, btype, initVals);
+                break;
+            }
+            case TType::EmptyStmtT:
+                ret = new EmptyStmtAST();
+                break;
+            case TType::NilT:
+                ret = new NilAST();
+                break;
+            case TType::ExpStmtT:
+                ret = new ExpStmtAST(node());
+                break;
+            case TType::ReturnStmtT:
+                ret = new ReturnStmtAST(optional());
+                break;
+            case TType::ForStmtT: {
+                auto id = u32();
+                auto init = node();
+                auto cond = node();
+                auto post = node();
+                auto body = node();
+                ret = new ForStmtAST(id, init, cond, post, body);
+                ctx.nextForId = max(ctx.nextForId, id + 1);
+                break;
+            }
+            case TType::BranchStmtT: {
+                auto t = BranchStmtAST::Type(u8());
+                ret = new BranchStmtAST(t, str());
+                break;
+            }
+            case TType::IncDecStmtT: {
+                auto target = node();
+                ret = new IncDecStmtAST(target, u8());
+                break;
+            }
+            case TType::ShortVarDeclT: {
+                bool isDefine = u8();
+                auto targets = list();
+                auto initVals = list();
+                ret = new ShortVarDeclAST(isDefine, targets, initVals);
+                break;
+            }
+            case TType::IfStmtT: {
+                auto t = IfStmtAST::Type(u8());
+                auto init = optional();
+                auto cond = node();
+                auto body = node();
+                auto elseBlockStmt = optional();
+                ret = new IfStmtAST(t, init, cond, body, elseBlockStmt);
+                break;
+            }
+            case TType::LValT: {
+                auto s = sym();
+                auto indexList = list();
+                ret = new LValAST(s, ctx.names.Name(s), indexList, str());
+                break;
+            }
+            case TType::NumberT:
+                ret = new NumberAST(i64());
+                break;
+            case TType::BinExpT: {
+                auto& op = str();
+                auto left = node();
+                auto right = node();
+                ret = new BinExpAST(op, left, right);
+                break;
+            }
+            case TType::UnaryExpT: {
+                char op = u8();
+                ret = new UnaryExpAST(op, node());
+                break;
+            }
+            case TType::ParenExpT:
+                ret = new ParenExpAST(node());
+                break;
+            case TType::CallExpT: {
+                auto s = sym();
+                ret = new CallExpAST(s, ctx.names.Name(s), list());
+                break;
+            }
+            case TType::MakeExpT: {
+                auto t = node();
+                ret = new MakeExpAST(t, node());
+                break;
+            }
+            case TType::ArrayExpT: {
+                auto t = node();
+                ret = new ArrayExpAST(t, list());
+                break;
+            }
+            default:
+                cerr << "AstReader: unknown node type " << int(type) << endl;
+                throw CompileError();
+        }
+        if (pos != end) {
+            cerr << "AstReader: bad size of node " << int(type) << endl;
+            throw CompileError();
+        }
+        return ret;
+    }
+
+   public:
+    /**
+     * @brief Construct a new AstReader object
+     *
+     * @param data the bytes of the file, not copied
+     * @param ctx the context to intern the names into and to allocate the
+     * nodes from, like the one of a parse
+     */
+    AstReader(string_view data, ParseContext& ctx) : data(data), ctx(ctx) {}
+
+    /**
+     * @brief whether the bytes are a binary AST, of any version
+     */
+    static bool IsAstFile(string_view data) {
+        return data.size() >= AstFormat::headerSize &&
+               memcmp(data.data(), AstFormat::magic, 4) == 0;
+    }
+
+    /**
+     * @brief read the CompUnitAST, error if the file is bad
+     *
+     * @return unique_ptr<BaseAST> - the CompUnitAST
+     */
+    unique_ptr<BaseAST> Read() {
+        if (!IsAstFile(data)) {
+            cerr << "AstReader: not a binary AST" << endl;
+            throw CompileError();
+        }
+        pos = 4;
+        if (auto version = u32(); version != AstFormat::version) {
+            cerr << "AstReader: binary AST of version " << version
+                 << ", but the compiler reads version " << AstFormat::version
+                 << ", parse the source again" << endl;
+            throw CompileError();
+        }
+        auto n = u32();
+        syms.reserve(n);
+        for (; n > 0; n--) {
+            auto len = u32();
+            need(len);
+            syms.push_back(ctx.names.Intern(data.substr(pos, len)));
+            pos += len;
+        }
+        AstArena::Use use(ctx.arena);
+        unique_ptr<BaseAST> unit(node());
+        if (unit->type() != TType::CompUnitT || pos != data.size()) {
+            cerr << "AstReader: bad root" << endl;
+            throw CompileError();
+        }
+        return unit;
+    }
+};
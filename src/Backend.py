@@ -1,6 +1,7 @@
 # %%
 # %%
 import os
+import re
 import llvmlite.binding as llvm
 import copy
 from random import choice
@@ -117,6 +118,14 @@ def color_graph(g: Graph, regs: Collection[str], colors: List[str]) -> Optional[
     return coloring
 
 
+def sizeOf(t: str) -> int:
+    # e.g. "[5 x [4 x i64]]" -> 160, "i64*" -> 8
+    size = 8
+    for n in re.findall(r'\[(\d+) x', t):
+        size *= int(n)
+    return size
+
+
 def save(regs) -> List[str]:
     if regs == None:
         regs = [f'r{x}' for x in range(8, 16)]
@@ -143,12 +152,28 @@ def codeGenForFunc(fn: ValueRef, globalNames: List[str],
     useDef: Dict[int, List[Any]] = {}
     labelToIdx: Dict[str, int] = {}
 
+    # the block of each instruction
+    insBlock: List[str] = []
+    # phis are done by copies at the end of the preds
+    # pred label -> [(phi, incoming value)]
+    phiMoves: Dict[str, List[Tuple[str, str]]] = {}
+    phiSucc: Dict[str, str] = {}
+
     for b in fn.blocks:
         labelToIdx[b.name] = len(
             [_ for _ in ins if _.opcode not in ["alloca"]])  # TODO ensure this
         ins += [_ for _ in b.instructions]
-    # if '' in labelToIdx.keys():
-    labelToIdx.pop("")
+        insBlock += [b.name] * (len(ins) - len(insBlock))
+        for i in b.instructions:
+            if i.opcode != "phi":
+                continue
+            # e.g. %phi0 = phi i64 [ %t1, %entry.0 ], [ 0, %for.0.post ]
+            for val, pred in re.findall(r'\[\s*([^,\]]+?),\s*%([^\s\]]+)\s*\]', str(i)):
+                if phiSucc.setdefault(pred, b.name) != b.name:
+                    raise Exception("phis in more than one succ of " + pred)
+                phiMoves.setdefault(pred, []).append((i.name, val))
+    # the entry block may be unnamed
+    labelToIdx.pop("", None)
 
     print(labelToIdx)
 
@@ -156,16 +181,18 @@ def codeGenForFunc(fn: ValueRef, globalNames: List[str],
 
     # collect allocas and construct use-def chain
     idx = 0
-    for i in ins:
+    # idx of br -> the copies for the phis of its succ
+    phiMovesAt: Dict[int, List[Tuple[str, str]]] = {}
+    for k, i in enumerate(ins):
         op = i.opcode
         if op == "alloca":
-            # TODO spill also increase size
             # TODO not actually alloca for arg4+
             if str(i.type) == "i32*":
                 # allocas[i.name] = 4
                 allocas[i.name] = 8
             else:
-                allocas[i.name] = 8
+                # e.g. "[5 x i64]*" for an array on the stack
+                allocas[i.name] = sizeOf(str(i.type)[:-1])
             idx -= 1
         elif op == "store":
             use = []
@@ -175,11 +202,21 @@ def codeGenForFunc(fn: ValueRef, globalNames: List[str],
             useDef[idx] = [i, set(use), set()]
         elif op == "br":
             use = []
+            defs = []
             for j in i.operands:
                 if str(j.type) != "label":
                     if j.name != "" and j.name not in allocas:
                         use.append(j.name)
-            useDef[idx] = [i, set(use), set()]
+            # the copies use the incoming values and def the phis
+            phiMovesAt[idx] = phiMoves.get(insBlock[k], [])
+            for dst, src in phiMovesAt[idx]:
+                if src.startswith('%'):
+                    use.append(src[1:])
+                defs.append(dst)
+            useDef[idx] = [i, set(use), set(defs)]
+        elif op == "phi":
+            # done by the br of the preds
+            useDef[idx] = [i, set(), set()]
         elif op == "call":
             use = []
             defs = []
@@ -262,8 +299,6 @@ def codeGenForFunc(fn: ValueRef, globalNames: List[str],
               "|", pretty(theIn[i]), pretty(theOut[i]))
 
     print(allocas)
-    local = 8 * len(allocas)
-    print(local)
 
     allTemp = set.union(*([useDef[idx][2]
                         for idx in useDef] + [useDef[idx][3] for idx in useDef]))
@@ -287,10 +322,27 @@ def codeGenForFunc(fn: ValueRef, globalNames: List[str],
     g = build_graph()
     colors = [i for i in range(8)]
     coloring = color_graph(g, list(allTemp), colors)
-    colorNeeded = len(set(coloring.values()))
+    # spilled temp -> depth in the stack
+    spilled: Dict[str, int] = {}
+    if coloring is None:
+        # not enough regs, spill the temps with the most neighbors,
+        # and keep r14, r15 to load them
+        colors = [i for i in range(6)]
+        regs = list(allTemp)
+        g2 = copy.copy(g)
+        while coloring is None:
+            victim = max(regs, key=lambda r: len(g2.neighbors(r)))
+            regs.remove(victim)
+            g2.remove_node(victim)
+            spilled[victim] = sum(allocas.values()) + 8 * (len(spilled) + 1)
+            coloring = color_graph(g2, regs, colors)
+    colorNeeded = 8 if spilled else len(set(coloring.values()))
+    local = sum(allocas.values()) + 8 * len(spilled)
+    print(local)
     note = ["coloring: " + str(coloring)]
     note += ["single nodes: " + str(set(allTemp) - set(g.all_nodes()))]
     note += ["color needed: " + str(colorNeeded)]
+    note += ["spilled: " + str(spilled)]
     note = "\n".join(note)
     print(note)
     # output the note about the graph
@@ -306,25 +358,34 @@ def codeGenForFunc(fn: ValueRef, globalNames: List[str],
     # get depth in the stack
     depth: Dict[str, int] = {}
     for k, v in allocas.items():
-        sum = 0
+        total = 0
         for k2, v2 in allocas.items():
-            sum += v2
+            total += v2
             if k == k2:
                 break
-        depth[k] = sum
+        depth[k] = total
     print("depth", depth)
 
+    # spilled temp -> the scratch reg holding it in current instruction
+    scratch: Dict[str, str] = {}
+
     # to real register
     def toR(reg: str | ValueRef, deRefer=False) -> str:
-        if reg.name != '':
+        if isinstance(reg, str):
+            pass
+        elif reg.name != '':
             reg = reg.name
         else:
             reg = str(reg)
-        # now: "i32 0" / "t99"
+        # now: "i32 0" / "i1 true" / "t99"
         print("toR", reg)  # debug
-        if 'i32' in reg or 'i64' in reg:
+        if reg.startswith('i1 '):
+            # const bool from folded conditions
+            return '$1' if reg.split(' ')[1] in ['true', '1'] else '$0'
+        if ' ' in reg:
+            # a const like "i64 5", names never have spaces
             _, n = reg.split(' ')
-            if n == 'null':
+            if n in ['null', 'undef']:
                 return '$0'
             return f"${n}"
         elif deRefer and reg in globalNames:
@@ -349,6 +410,10 @@ def codeGenForFunc(fn: ValueRef, globalNames: List[str],
                 return f'{-depth[X]}(%rbp)'
         elif deRefer and 'local_' in reg:
             return f'{-depth[reg]}(%rbp)'
+        if reg in scratch:
+            return f'({scratch[reg]})' if deRefer else scratch[reg]
+        if reg in spilled:
+            return f'-{spilled[reg]}(%rbp)'
         if deRefer:
             return f'(%r{coloring[reg]+8})'
         return f"%r{coloring[reg]+8}"
@@ -357,6 +422,32 @@ def codeGenForFunc(fn: ValueRef, globalNames: List[str],
     def isImm(*regs) -> List[int | None]:
         return [int(reg[1:]) if reg[0] == '$' else None for reg in regs]
 
+    # the incoming value of a phi, e.g. "%t1", "0", "null"
+    def phiSrcToR(src: str) -> str:
+        if src.startswith('%'):
+            return toR(src[1:])
+        if src in ['null', 'undef', 'false']:
+            return '$0'
+        if src == 'true':
+            return '$1'
+        return f'${src}'
+
+    # the parallel copies for the phis, done before the br
+    def phiCopies(idx: int) -> List[str]:
+        moves = [(toR(dst), phiSrcToR(src))
+                 for dst, src in phiMovesAt.get(idx, [])]
+        moves = [(d, s) for d, s in moves if d != s]
+        if len(moves) == 1 and not ('(' in moves[0][0] and '(' in moves[0][1]):
+            return [f"movq {moves[0][1]}, {moves[0][0]}"]
+        # read all before write any
+        return [f"pushq {s}" for d, s in moves] + \
+            [f"popq {d}" for d, s in moves][::-1]
+
+    # truncated division like C and Go
+    def divTrunc(a: int, b: int) -> int:
+        q = abs(a) // abs(b)
+        return q if (a < 0) == (b < 0) else -q
+
     asm: List[str] = []
     asm += [f"\t.globl {funcName}"]
     asm += [f"\t{funcName}:"]
@@ -370,6 +461,21 @@ def codeGenForFunc(fn: ValueRef, globalNames: List[str],
         op = i.opcode
         regs = [_ for _ in i.operands]
         cmds = []
+        # load the spilled temps to the scratch regs
+        # note: call and br can take them from the stack directly
+        scratch.clear()
+        pre = []
+        post = []
+        if spilled and op not in ['call', 'br', 'phi']:
+            free = ['%r14', '%r15']
+            for j in regs:
+                if j.name in spilled and j.name not in scratch:
+                    scratch[j.name] = free.pop(0)
+                    pre += [f"movq -{spilled[j.name]}(%rbp), {scratch[j.name]}"]
+            if i.name in spilled:
+                # the uses are read before the def is written
+                scratch[i.name] = '%r14'
+                post += [f"movq %r14, -{spilled[i.name]}(%rbp)"]
         # insert label
         label = idxToLabel.get(idx, None)
         if label != None:
@@ -486,8 +592,8 @@ def codeGenForFunc(fn: ValueRef, globalNames: List[str],
             if optimize:
                 isI = isImm(rs1, rs2)
                 # both are imm
-                if None not in isI:
-                    res = isI[0] / isI[1]
+                if None not in isI and isI[1] != 0:
+                    res = divTrunc(isI[0], isI[1])
                     cmds = [f"movq ${res}, {rd}"]
         elif op == "srem":
             rs1 = toR(regs[0])
@@ -510,8 +616,8 @@ def codeGenForFunc(fn: ValueRef, globalNames: List[str],
             if optimize:
                 isI = isImm(rs1, rs2)
                 # both are imm
-                if None not in isI:
-                    res = isI[0] % isI[1]
+                if None not in isI and isI[1] != 0:
+                    res = isI[0] - isI[1] * divTrunc(isI[0], isI[1])
                     cmds = [f"movq ${res}, {rd}"]
         elif op == 'store':
             rs = toR(regs[0])
@@ -549,6 +655,10 @@ def codeGenForFunc(fn: ValueRef, globalNames: List[str],
             rd = toR(i)
             toProtect = ['%rax']
             # cmds += [f"pushq {r}" for r in toProtect]
+            if '$' in a:
+                # cmpq cannot take an imm as the second operand
+                cmds += [f"movq {a}, %rcx"]
+                a = "%rcx"
             cmds += [f"movq $0, %rax"]
             # this is "a-b"
             cmds += [f"cmpq {b}, {a}"]
@@ -557,29 +667,45 @@ def codeGenForFunc(fn: ValueRef, globalNames: List[str],
             # cmds += [f"popq {r}" for r in toProtect][::-1]
         elif op == 'br':
             # None if no label in next line
-            nextLineLabel = idxToLabel.get(idx, None)
+            nextLineLabel = idxToLabel.get(idx+1, None)
             labels = []
             for j in regs:
                 if str(j.type) == "label":
                     labels += [j.name]
             labels.reverse()  # the right order
+            copies = phiCopies(idx)
             if len(labels) == 1 and labelToIdx.get(labels[0]) != idx+1:
-                cmds = [f"jmp {labels[0]}"]
+                cmds = copies + [f"jmp {labels[0]}"]
                 if optimize:
                     if nextLineLabel != None and nextLineLabel == labels[0]:
                         # next line is label, no need to jmp
-                        cmds = []
+                        cmds = copies
+            elif len(labels) == 1:
+                cmds = copies
             elif len(labels) == 2:
                 # assert the first label is always next line
                 if nextLineLabel != None and nextLineLabel != labels[0]:
                     raise Exception("br first label is not next line")
                 # asm += [f"\t{str(labels)}"]
                 rs = toR(regs[0])
-                cmds += [f"cmpq $0, {rs}"]
-                cmds += [f"je {labels[1]}"]
+                isI = isImm(rs)
+                if isI[0] is not None:
+                    # const cond, the first label is the next line
+                    cmds += copies
+                    if isI[0] == 0:
+                        cmds += [f"jmp {labels[1]}"]
+                else:
+                    cmds += [f"cmpq $0, {rs}"]
+                    # movq, pushq and popq keep the flags
+                    cmds += copies
+                    cmds += [f"je {labels[1]}"]
         elif op == 'call':
             rd = toR(i) if i.name != '' else None
             fn = regs[-1].name + "@PLT"
+            if regs[-1].name.startswith("llvm.memset."):
+                # the intrinsic is libc memset, whose args are the same
+                # except the last i1 which is ignored
+                fn = "memset@PLT"
             args = [toR(_) for _ in regs[:-1]]
             theMap = {
                 0: "%rdi",
@@ -587,6 +713,12 @@ def codeGenForFunc(fn: ValueRef, globalNames: List[str],
                 2: "%rdx",
                 3: "%rcx",
             }
+            # r8-r11 are caller-saved, keep the temps living across the call
+            toKeep = sorted(set(
+                toR(_) for _ in theOut[idx]
+                if _ != i.name and _ in coloring and _ not in spilled))
+            toKeep = [r for r in toKeep if r in ['%r8', '%r9', '%r10', '%r11']]
+            cmds += [f"pushq {r}" for r in toKeep]
             # args
             reversePush = []
             for x, arg in enumerate(args):
@@ -596,8 +728,11 @@ def codeGenForFunc(fn: ValueRef, globalNames: List[str],
                     reversePush += [f"pushq {arg}"]
             cmds += reversePush[::-1]
             cmds += [f"call {fn}"]
+            if len(reversePush) > 0:
+                cmds += [f"addq ${8 * len(reversePush)}, %rsp"]
             if rd != None:
                 cmds += [f"movq %rax, {rd}"]
+            cmds += [f"popq {r}" for r in toKeep][::-1]
         elif op == 'ret':
             if len(regs) != 0:
                 res = toR(regs[0])
@@ -619,14 +754,21 @@ def codeGenForFunc(fn: ValueRef, globalNames: List[str],
             cmds += [f"leaq ({rs1},{rs2},{8}), {rd}"]
             # cmds += [f"popq {r}" for r in toProtect][::-1]
         elif op == 'bitcast':
-            rs = toR(regs[0])
             rd = toR(i)
-            cmd = f"movq {rs}, {rd}"
+            if regs[0].name in allocas:
+                # the address of an array on the stack
+                cmd = f"leaq -{depth[regs[0].name]}(%rbp), {rd}"
+            else:
+                rs = toR(regs[0])
+                cmd = f"movq {rs}, {rd}"
             cmds = [cmd]
+        elif op in ['phi', 'unreachable']:
+            # phi is done by the copies in the preds
+            cmds = []
         else:
             raise Exception(f"Unknown op: {op}")
         asm += [f'  #{str(i)}']
-        asm += cmds
+        asm += pre + cmds + post
         print("  -", cmds)
 
     asm += [f"\t{funcName}_end:"]
@@ -0,0 +1,153 @@
+#pragma once
+
+/**
+ * @file Cache.hpp
+ * @author Asilvorcarp (asilvorcarp@qq.com)
+ * @brief the cache of the outputs, keyed by the hash of the source, the
+ * compiler and the flags
+ * @version 2.0
+ * @date 2023-06-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <IRWriter.hpp>
+#include <Sha256.hpp>
+#include <Source.hpp>
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief the version of the compiler in the keys, so that the outputs of
+ * another compiler are never used
+ * @note the Makefile defines MINIGO_SOURCE_HASH as the hash of the sources
+ * of the compiler, so that a fresh checkout building the same compiler hits
+ * the cache, otherwise it changes with each build
+ */
+#ifdef MINIGO_SOURCE_HASH
+const static string compilerVersion = "miniGo 2.0 " MINIGO_SOURCE_HASH;
+#else
+const static string compilerVersion = "miniGo 2.0 " __DATE__ " " __TIME__;
+#endif
+
+/**
+ * @brief a directory of outputs named by the hash of what made them
+ * @note a file is written to a temp name and renamed, so concurrent
+ * compilers sharing the directory never see a partial file
+ */
+class CompileCache {
+    filesystem::path dir;
+
+    /**
+     * @brief add the bytes to the digest after their length, so that the
+     * pieces of a key never run into each other
+     */
+    static void addPiece(Sha256& sha, string_view bytes) {
+        sha.Update(to_string(bytes.size()) + ':');
+        sha.Update(bytes);
+    }
+
+    /**
+     * @brief copy the file, by a temp file and rename
+     */
+    static bool copyFile(const filesystem::path& from,
+                         const filesystem::path& to) {
+        error_code ec;
+        filesystem::path tmp = TempPath(to.string());
+        filesystem::copy_file(from, tmp,
+                              filesystem::copy_options::overwrite_existing, ec);
+        if (ec) {
+            filesystem::remove(tmp, ec);
+            return false;
+        }
+        filesystem::rename(tmp, to, ec);
+        if (ec) {
+            filesystem::remove(tmp, ec);
+            return false;
+        }
+        return true;
+    }
+
+   public:
+    /**
+     * @brief Construct a new CompileCache object, creating the directory
+     *
+     * @param dir the directory
+     */
+    CompileCache(const string& dir) : dir(dir) {
+        error_code ec;
+        filesystem::create_directories(this->dir, ec);
+    }
+
+    /**
+     * @brief get the key of the output
+     *
+     * @param source the source code
+     * @param flags the flags changing the output, including its kind
+     * @return string - the SHA-256 in 64 hex digits
+     */
+    static string Key(string_view source, const string& flags) {
+        Sha256 sha;
+        addPiece(sha, compilerVersion);
+        addPiece(sha, flags);
+        addPiece(sha, source);
+        return sha.HexDigest();
+    }
+
+    /**
+     * @brief get the key of the output of a command, like clang making a
+     * binary from the .ll, see `miniGo cached`
+     *
+     * @param command the command and its args
+     * @param inputs the files the output is made from
+     * @return string - the SHA-256 in 64 hex digits
+     */
+    static string CommandKey(const vector<string>& command,
+                             const vector<string>& inputs) {
+        // not the version of miniGo, the output depends on the command and
+        // the inputs only
+        Sha256 sha;
+        addPiece(sha, "command");
+        for (auto& arg : command) {
+            addPiece(sha, arg);
+        }
+        addPiece(sha, "inputs");
+        for (auto& input : inputs) {
+            SourceFile file(input);
+            addPiece(sha, file.Text());
+        }
+        return sha.HexDigest();
+    }
+
+    /**
+     * @brief copy the cached output to the file if there is one
+     *
+     * @param key the key from Key()
+     * @param out the output file
+     * @return true if hit
+     */
+    bool Fetch(const string& key, const string& out) {
+        auto cached = dir / key;
+        if (!filesystem::exists(cached)) {
+            return false;
+        }
+        return copyFile(cached, out);
+    }
+
+    /**
+     * @brief save the output to the cache
+     *
+     * @param key the key from Key()
+     * @param out the output file
+     */
+    void Store(const string& key, const string& out) {
+        copyFile(out, dir / key);
+    }
+};
@@ -12,7 +12,12 @@
  */
 
 #include <AST.hpp>
+#include <Escape.hpp>
+#include <Hoist.hpp>
+#include <IRWriter.hpp>
+#include <SSA.hpp>
 #include <Scope.hpp>
+#include <Type.hpp>
 
 using namespace std;
 
@@ -26,9 +31,62 @@ class Compiler {
      */
     CompUnitAST* file;
     /**
-     * @brief the current scope
+     * @brief the owner of all types used in this compilation
+     */
+    TypeContext types;
+    /**
+     * @brief the table of the visible objects, see enterScope()
      */
     Scope* scope;
+    /**
+     * @brief the SSA builder of the function being compiled
+     */
+    SSABuilder ssa;
+    /**
+     * @brief the text of the function being compiled, reused by all the
+     * functions, see SSABuilder::finish
+     */
+    StringBuf funcBuf;
+    /**
+     * @brief the allocas of the function being compiled, which are put in
+     * the entry block so that loops do not grow the stack
+     */
+    string entryAllocas;
+    /**
+     * @brief the values loaded in the current block, ptr -> (type, value),
+     * until a store of the same type or a call
+     * @note a store of a type never changes a load of another type, since
+     * each array has only one element type
+     */
+    unordered_map<string, pair<const Type*, string>> loadCache;
+    /**
+     * @brief the element ptrs computed in the current block, like
+     * "i64, i64* %t1, i64 %t2" -> %t3
+     */
+    unordered_map<string, string> addrCache;
+    /**
+     * @brief the rows loaded before the loops being compiled, like
+     * "%local_a.1[%local_i.2]" -> %t5, see LoopInvariants
+     */
+    unordered_map<string, string> hoistedRows;
+    /**
+     * @brief the max size in bytes of an array allocated on the stack
+     */
+    int maxStackAlloc = 4096;
+    /**
+     * @brief the max size in bytes of an array from make() zeroed by memset
+     * after malloc, a larger one is from calloc
+     */
+    int maxMemsetZero = 256;
+    /**
+     * @brief the size in i64s of the header {len, cap} before each array
+     */
+    static constexpr int arrayHeaderWords = 2;
+    /**
+     * @brief the function make() calls to allocate on the heap, @malloc or
+     * @runtime_alloc for the arena of the runtime
+     */
+    string allocFunc = "@malloc";
     /**
      * @brief id for generated temp (%t0, %t1, ...) and labels, use with ++
      */
@@ -48,42 +106,50 @@ class Compiler {
 
     /**
      * @brief Construct a new Compiler object with the Universe scope
+     *
+     * @param names the interner of the names in the AST to compile
      */
-    Compiler() : scope(Scope::Universe()) {}
-    ~Compiler() {}
+    Compiler(Interner& names) : scope(Scope::Universe(types, names)) {}
+    ~Compiler() { delete scope; }
 
     /**
      * @brief compile the whole CompUnitAST (the file)
+     * @note the IR is written as soon as each function is done, so only one
+     * function is buffered at a time
      * 
      * @param _file the CompUnitAST (file) to compile
-     * @return string, the compiled LLVM IR code
+     * @param os the ostream to write the LLVM IR code to
      */
-    string Compile(CompUnitAST* _file) {
-        stringstream ss;
-
+    void Compile(CompUnitAST* _file, ostream& os) {
         file = _file;
 
-        genHeader(ss, file);
-        compileFile(ss, file);
-        genMain(ss, file);
+        foldFile(file);
+        EscapeAnalysis().Run(file);
+        genHeader(os, file);
+        compileFile(os, file);
+        genMain(os, file);
+    }
 
+    /**
+     * @brief compile the whole CompUnitAST (the file)
+     * 
+     * @param _file the CompUnitAST (file) to compile
+     * @return string, the compiled LLVM IR code
+     */
+    string Compile(CompUnitAST* _file) {
+        stringstream ss;
+        Compile(_file, ss);
         return ss.str();
     }
 
     /**
      * @brief enter a new scope
      */
-    void enterScope() { scope = new Scope(scope); }
+    void enterScope() { scope->Enter(); }
     /**
      * @brief leave the current scope to the outer scope
      */
-    void leaveScope() { scope = scope->Outer; }
-    /**
-     * @brief restore the scope to the given scope
-     * 
-     * @param s the scope to restore to
-     */
-    void restoreScope(Scope* s) { scope = s; }
+    void leaveScope() { scope->Leave(); }
 
     /**
      * @brief generate the header, including the package name and the runtime functions
@@ -119,11 +185,7 @@ class Compiler {
      * 
      * @return string - the temp's id
      */
-    string genId() {
-        stringstream ss;
-        ss << "%t" << nextId++;
-        return ss.str();
-    }
+    string genId() { return numbered("%t", nextId++); }
 
     /**
      * @brief generate a new label with unique id
@@ -131,10 +193,281 @@ class Compiler {
      * @param name the label's name
      * @return string - the label
      */
-    string genLabelId(string name) {
-        stringstream ss;
-        ss << name << "." << nextId++;
-        return ss.str();
+    string genLabelId(const string& name) {
+        return numbered(name + ".", nextId++);
+    }
+
+    /**
+     * @brief start a new basic block with the label
+     * 
+     * @param os the ostream to write to
+     * @param label the label of the block
+     * @param sealed whether all the preds of the block are known, false for
+     * the loop header before its back edge is generated
+     */
+    void startBlock(ostream& os, const string& label, bool sealed = true) {
+        os << "\n" << label << ":\n";
+        ssa.startBlock(label, os.tellp());
+        loadCache.clear();
+        addrCache.clear();
+        if (sealed) {
+            ssa.seal(label);
+        }
+    }
+
+    /**
+     * @brief generate a br to the label, which ends the current block
+     * @note nothing is generated if the current block is already ended, e.g.
+     * by a return or break
+     * 
+     * @param os the ostream to write to
+     * @param label the label to jump to
+     */
+    void genBr(ostream& os, const string& label) {
+        if (!ssa.reachable()) {
+            return;
+        }
+        os << "\tbr label %" << label << "\n";
+        ssa.addEdge(label);
+        ssa.terminate();
+    }
+
+    /**
+     * @brief generate a conditional br, which ends the current block
+     * 
+     * @param os the ostream to write to
+     * @param cond the i1 condition
+     * @param trueLabel the label to jump to if cond is true
+     * @param falseLabel the label to jump to if cond is false
+     */
+    void genCondBr(ostream& os, const string& cond, const string& trueLabel,
+                   const string& falseLabel) {
+        if (!ssa.reachable()) {
+            return;
+        }
+        os << "\tbr i1 " << cond << ", label %" << trueLabel << ", label %"
+           << falseLabel << "\n";
+        ssa.addEdge(trueLabel);
+        ssa.addEdge(falseLabel);
+        ssa.terminate();
+    }
+
+    /**
+     * @brief generate the LLVM IR of loading a var, or just read its value if
+     * the var is promoted
+     * 
+     * @param os the ostream to write to
+     * @param varType var's type
+     * @param ptrName var's mangled name, or the ptr to the element
+     * @return string - the value
+     */
+    string genLoad(ostream& os, const Type* varType, const string& ptrName) {
+        if (ssa.isPromoted(ptrName)) {
+            return ssa.read(ptrName);
+        }
+        auto it = loadCache.find(ptrName);
+        if (it != loadCache.end()) {
+            return it->second.second;
+        }
+        auto localName = genId();
+        os << "\t" << localName << " = load " << varType->str() << ", "
+           << increaseDim(varType)->str() << " " << ptrName << ", align 4\n";
+        loadCache[ptrName] = {varType, localName};
+        return localName;
+    }
+
+    /**
+     * @brief generate the LLVM IR of storing to a var, or just set its value
+     * if the var is promoted
+     * 
+     * @param os the ostream to write to
+     * @param varType var's type
+     * @param val the value to store
+     * @param ptrName var's mangled name, or the ptr to the element
+     */
+    void genStore(ostream& os, const Type* varType, const string& val,
+                  const string& ptrName) {
+        if (ssa.isPromoted(ptrName)) {
+            ssa.write(ptrName, val);
+            return;
+        }
+        // the ptr may alias any cached ptr of the same type
+        for (auto it = loadCache.begin(); it != loadCache.end();) {
+            if (it->second.first == varType) {
+                it = loadCache.erase(it);
+            } else {
+                it++;
+            }
+        }
+        os << "\tstore " << varType->str() << " " << val << ", "
+           << increaseDim(varType)->str() << " " << ptrName << "\n";
+        loadCache[ptrName] = {varType, val};
+    }
+
+    /**
+     * @brief generate the ptr to an element of an array, like &a[i][j]
+     * @note the longest row hoisted out of the loops is used as the start,
+     * and the ptrs already computed in the block are reused
+     * 
+     * @param os the ostream to write to
+     * @param lval the LValAST with indices
+     * @param n the number of indices to apply
+     * @return pair<string, const Type*> - the ptr and the element type
+     */
+    pair<string, const Type*> genElemPtr(ostream& os, LValAST* lval, int n) {
+        auto obj = scope->Lookup(lval->sym);
+        int start = 0;
+        string ptrValName;
+        for (int k = n - 1; k > 0 && !hoistedRows.empty(); k--) {
+            auto it = hoistedRows.find(LoopInvariants::Key(scope, lval, k));
+            if (it != hoistedRows.end()) {
+                start = k;
+                ptrValName = it->second;
+                break;
+            }
+        }
+        string ptrName = obj->MangledName;
+        auto curType = reduceDim(obj->Ty, start);
+        for (int j = start; j < n; ++j) {
+            auto& idxExp = lval->indexList->at(j);
+            auto idxName = compileExpr(os, idxExp);
+            // assert idxExp is int, type checking
+            if (!inferType(idxExp)->isInt()) {
+                cerr << "compileExpr: index expression is not int" << endl;
+                throw CompileError();
+            }
+            if (j > start || start == 0) {
+                ptrValName = genLoad(os, curType, ptrName);
+            }
+            auto redCurType = reduceDim(curType);
+            auto gep = redCurType->str() + ", " + curType->str() + " " +
+                       ptrValName + ", i64 " + idxName;
+            auto it = addrCache.find(gep);
+            if (it != addrCache.end()) {
+                ptrName = it->second;
+            } else {
+                ptrName = genId();
+                os << "\t" << ptrName << " = getelementptr inbounds " << gep
+                   << "\n";
+                addrCache[gep] = ptrName;
+            }
+            curType = redCurType;
+        }
+        return {ptrName, curType};
+    }
+
+    /**
+     * @brief allocate an array that never escapes on the stack
+     * 
+     * @param os the ostream to write to
+     * @param words the size in i64s, including the header
+     * @return string - the i64* to the beginning
+     */
+    string genStackAlloc(ostream& os, int64_t words) {
+        auto arrType = types.ArrayOf(types.Int(), words);
+        auto slot = genId();
+        entryAllocas += "\t" + slot + " = alloca " + arrType->str() +
+                        ", align 8\n";
+        auto localName = genId();
+        os << "\t" << localName << " = bitcast " << arrType->str() << "* "
+           << slot << " to i64*" << endl;
+        return localName;
+    }
+
+    /**
+     * @brief zero the memory with llvm.memset, which llc turns into a few
+     * stores for a small const size
+     * 
+     * @param os the ostream to write to
+     * @param ptrType the type of the ptr, like "i64*"
+     * @param ptr the ptr to the memory
+     * @param size the size in bytes, a temp or an immediate
+     */
+    void genMemset(ostream& os, const string& ptrType, const string& ptr,
+                   const string& size) {
+        auto i8pName = genId();
+        os << "\t" << i8pName << " = bitcast " << ptrType << " " << ptr
+           << " to i8*" << endl;
+        os << "\tcall void @llvm.memset.p0i8.i64(i8* " << i8pName
+           << ", i8 0, i64 " << size << ", i1 false)" << endl;
+    }
+
+    /**
+     * @brief allocate an array with its header {len, cap} right before the
+     * first element, so that len() and cap() are just loads
+     * @note the layout is [len, cap, elem0, elem1, ...] and the array value
+     * points to elem0, so indexing is not changed
+     * 
+     * @param os the ostream to write to
+     * @param arrType the type of the array, like "i64*"
+     * @param len the number of elements, a temp or an immediate
+     * @param onStack whether the array never escapes the function
+     * @param zeroed whether the elements are zeroed, false if all of them are
+     * stored right after
+     * @return string - the ptr to the first element
+     */
+    string genArrayAlloc(ostream& os, const Type* arrType, const string& len,
+                         bool onStack, bool zeroed) {
+        auto elemSize = reduceDim(arrType)->size();
+        bool isConst = isdigit(len[0]);
+        int64_t constLen = isConst ? stoll(len) : -1;
+        string base;
+        if (onStack && isConst && constLen * elemSize <= maxStackAlloc) {
+            // alloca on stack, if it never escapes and has a small const len
+            base = genStackAlloc(os, arrayHeaderWords + constLen * elemSize / 8);
+            if (zeroed && constLen > 0) {
+                genMemset(os, "i64*", base,
+                          to_string(arrayHeaderWords * 8 + constLen * elemSize));
+            }
+        } else {
+            // alloca on heap, call malloc or the arena
+            string sizeLocal;
+            if (isConst) {
+                sizeLocal = to_string(arrayHeaderWords * 8 + constLen * elemSize);
+            } else {
+                auto dataSize = genId();
+                os << "\t" << dataSize << " = mul i64 " << len << ", "
+                   << elemSize << endl;
+                sizeLocal = genId();
+                os << "\t" << sizeLocal << " = add i64 " << dataSize << ", "
+                   << arrayHeaderWords * 8 << endl;
+            }
+            // call allocFunc which returns i8*
+            // the arena is always zeroed since its pages are fresh from mmap,
+            // or malloc with memset for a small const size, or calloc which
+            // gets lazily zeroed pages from the OS for a large size
+            auto i8pName = genId();
+            bool small = isConst && constLen * elemSize <= maxMemsetZero;
+            if (zeroed && allocFunc == "@malloc" && !small) {
+                os << "\t" << i8pName << " = call noalias i8* @calloc(i64 1, "
+                   << "i64 " << sizeLocal << ")" << endl;
+            } else {
+                os << "\t" << i8pName << " = call noalias i8* " << allocFunc
+                   << "(i64 " << sizeLocal << ")" << endl;
+                if (zeroed && allocFunc == "@malloc" && constLen > 0) {
+                    genMemset(os, "i8*", i8pName, sizeLocal);
+                }
+            }
+            base = genId();
+            os << "\t" << base << " = bitcast i8* " << i8pName << " to i64*"
+               << endl;
+        }
+        // fill the header, cap is len since arrays never grow
+        auto capPtr = genId();
+        os << "\tstore i64 " << len << ", i64* " << base << endl;
+        os << "\t" << capPtr << " = getelementptr inbounds i64, i64* " << base
+           << ", i64 1" << endl;
+        os << "\tstore i64 " << len << ", i64* " << capPtr << endl;
+        auto dataPtr = genId();
+        os << "\t" << dataPtr << " = getelementptr inbounds i64, i64* " << base
+           << ", i64 " << arrayHeaderWords << endl;
+        if (arrType == types.PointerTo(types.Int())) {
+            return dataPtr;
+        }
+        auto localName = genId();
+        os << "\t" << localName << " = bitcast i64* " << dataPtr << " to "
+           << arrType->str() << endl;
+        return localName;
     }
 
     /**
@@ -144,16 +477,21 @@ class Compiler {
      * @param varType var's type
      * @param varMName var's mangled name
      */
-    void genDefaultInit(ostream& os, string varType, string varMName) {
-        if (varType == "i64") {
+    void genDefaultInit(ostream& os, const Type* varType, string varMName) {
+        if (ssa.isPromoted(varMName)) {
+            ssa.write(varMName, varType->isInt() ? "0" : "null");
+        } else if (varType->isInt()) {
             // may include i64 in the future
-            os << "\tstore " << varType << " 0, " << increaseDim(varType) << " "
-               << varMName << "\n";
+            os << "\tstore " << varType->str() << " 0, "
+               << increaseDim(varType)->str() << " " << varMName << "\n";
+        } else if (varType->isArray()) {
+            // the alloca of an array like [4 x i64]
+            genMemset(os, increaseDim(varType)->str(), varMName,
+                      to_string(varType->size()));
         } else {
-            // TODO maybe init array, ptr
-            if (debug) {
-                clog << "info: var not inited - " << varMName << endl;
-            }
+            // ptr is null
+            os << "\tstore " << varType->str() << " null, "
+               << increaseDim(varType)->str() << " " << varMName << "\n";
         }
     }
 
@@ -163,32 +501,37 @@ class Compiler {
      * @param os the ostream to write to
      * @param file the CompUnitAST (file) to compile
      */
-    void genInit(ostream& os, CompUnitAST* file) {
+    void genInit(ostream& _os, CompUnitAST* file) {
+        // buffered to insert the phis
+        funcBuf.clear();
+        ostream os(&funcBuf);
+        ssa = SSABuilder();
+        entryAllocas.clear();
         // the function to init globals
-        os << "define void @" << file->packageName << "_init() {\n";
+        os << "define void @" << file->packageName << "_init() {";
+        startBlock(os, genLabelId("entry"));
 
         for (auto& g : file->Globals) {
             int idNum = g->idents->size();
             int valNum = g->initVals->size();
             for (int i = 0; i < idNum; i++) {
-                auto obj = scope->Lookup(g->idents->at(i)).second;
+                auto obj = scope->Lookup(g->syms[i]);
                 if (obj == nullptr) {
                     cerr << "error: global variable undefined" << endl;
-                    assert(false);
+                    throw CompileError();
                 }
-                string varType = obj->Node->info();
+                auto varType = obj->Ty;
                 string mangledName = obj->MangledName;
                 // assert valNum == 0 || valNum == idNum;
                 if (valNum != 0 && valNum != idNum) {
                     cerr << "error: global id and init value number not match"
                          << endl;
-                    assert(false);
+                    throw CompileError();
                 }
                 if (valNum > 0) {
                     // init with val
                     auto valLocal = compileExpr(os, g->initVals->at(i));
-                    os << "\tstore " << varType << " " << valLocal << ", "
-                       << increaseDim(varType) << " " << mangledName << "\n";
+                    genStore(os, varType, valLocal, mangledName);
                 } else {
                     // init with default val (zero val)
                     genDefaultInit(os, varType, mangledName);
@@ -197,6 +540,7 @@ class Compiler {
         }
         os << "\tret void\n";
         os << "}\n";
+        ssa.finish(_os, funcBuf.str(), entryAllocas);
     }
 
     /**
@@ -206,35 +550,34 @@ class Compiler {
      * @param file the CompUnitAST (file) to compile
      */
     void compileFile(ostream& os, CompUnitAST* file) {
-        auto re = scope;
         enterScope();
 
         // register global vars
         // note: initialized in genInit()
         for (auto& g : file->Globals) {
             auto ast = g.get();  // VarSpecAST
-            // get mangled name
-            stringstream ss;
             int idNum = ast->idents->size();
-            string varType = g->info();
-            if (varType == "infer") {
+            if (ast->btype == nullptr) {
                 cerr << "error: global var type not specified" << endl;
-                assert(false);
+                throw CompileError();
             }
+            auto varType = typeOf(ast->btype.get());
             for (int i = 0; i < idNum; i++) {
                 string id = ast->idents->at(i);
-                ss << "@" << file->packageName << "_" << id;
-                string mangledName = ss.str();
-                scope->Insert(new Object(id, mangledName, ast));
+                // get mangled name
+                string mangledName = "@" + file->packageName + "_" + id;
+                scope->Insert(new Object(ast->syms[i], id, mangledName, ast,
+                                         varType));
                 if (isPtr(varType)) {
                     cerr << "error: global var for array not implemented yet"
                          << endl;
-                    assert(false);
+                    throw CompileError();
                     // TODO for array
                     // os << mangledName << " = common global " << varType
                     //    << " zeroinitializer\n";
                 } else {
-                    os << mangledName << " = global " << varType << " 0\n";
+                    os << mangledName << " = global " << varType->str()
+                       << " 0\n";
                 }
             }
         }
@@ -243,17 +586,17 @@ class Compiler {
         }
         // register global funcs
         for (auto& fn : file->Funcs) {
-            stringstream ss;
-            ss << "@" << file->packageName << "_" << fn->ident;
-            auto mangledName = ss.str();
-            scope->Insert(new Object(fn->ident, mangledName, fn.get()));
+            auto mangledName = "@" + file->packageName + "_" + fn->ident;
+            scope->Insert(
+                new Object(fn->sym, fn->ident, mangledName, fn.get(),
+                           typeOf(fn.get())));
         }
         for (auto& fn : file->Funcs) {
             compileFunc(os, file, fn.get());
         }
         genInit(os, file);
 
-        restoreScope(re);
+        leaveScope();
     }
 
     /**
@@ -263,82 +606,101 @@ class Compiler {
      * @param file the CompUnitAST (file) to compile
      * @param fn the FuncDefAST to compile
      */
-    void compileFunc(ostream& os, CompUnitAST* file, FuncDefAST* fn) {
+    void compileFunc(ostream& _os, CompUnitAST* file, FuncDefAST* fn) {
         auto paramMNameList = vector<string>();
-        auto retType = fn->getRetType();
-        auto paramTypes = fn->getParamTypes();
+        auto fnType = reinterpret_cast<const FuncType*>(typeOf(fn));
+        auto retType = fnType->ret;
+        auto& paramTypes = fnType->params;
         for (auto& _param : *fn->paramList) {
             auto param = reinterpret_cast<ParamAST*>(_param.get());
-            stringstream ss;
-            ss << "%local_" << param->ident << "." << varSuffix++;
-            string mangledName = ss.str();
+            string mangledName =
+                numbered("%local_" + param->ident + ".", varSuffix++);
             paramMNameList.push_back(mangledName);
         }
 
         // TODO add func decl option in .y and AST
         if (fn->body == nullptr) {
-            os << "declare " << retType << " @" << file->packageName << "_"
-               << fn->ident << "()\n";
+            _os << "declare " << retType->str() << " @" << file->packageName
+                << "_" << fn->ident << "()\n";
             return;
         }
-        os << endl;
-        os << "define " << retType << " @" << file->packageName << "_"
+        _os << endl;
+        // buffered to insert the phis
+        funcBuf.clear();
+        ostream os(&funcBuf);
+        ssa = SSABuilder();
+        entryAllocas.clear();
+        os << "define " << retType->str() << " @" << file->packageName << "_"
            << fn->ident << "(";
         // params list
         for (int i = 0; i < paramMNameList.size(); i++) {
-            os << paramTypes->at(i) << " " << paramMNameList[i] << ".arg" << i;
+            os << paramTypes[i]->str() << " " << paramMNameList[i] << ".arg"
+               << i;
             if (i != paramMNameList.size() - 1) {
                 os << ", ";
             }
         }
-        os << ") {\n";
+        os << ") {";
+        startBlock(os, genLabelId("entry"));
 
         // params + body scope
-        bool hasRet = false;
-        auto re = scope;
         enterScope();
         {
             // register params
             for (int i = 0; i < fn->paramList->size(); i++) {
                 auto param =
                     reinterpret_cast<ParamAST*>(fn->paramList->at(i).get());
-                auto paramType = param->info();
-                stringstream ss;
+                auto paramType = paramTypes[i];
                 auto mangledName = paramMNameList[i];
-                ss << mangledName << ".arg" << i;
-                string inputArgName = ss.str();
-                scope->Insert(new Object(param->ident, mangledName, param));
+                string inputArgName = numbered(mangledName + ".arg", i);
+                scope->Insert(
+                    new Object(param->sym, param->ident, mangledName, param,
+                               paramType));
 
-                os << "\t" << mangledName << " = alloca " << paramType
-                   << ", align 4\n";
-                os << "\tstore " << paramType << " " << inputArgName << ", "
-                   << increaseDim(paramType) << " " << mangledName << "\n";
+                if (paramType->isArray()) {
+                    os << "\t" << mangledName << " = alloca "
+                       << paramType->str() << ", align 4\n";
+                    os << "\tstore " << paramType->str() << " " << inputArgName
+                       << ", " << increaseDim(paramType)->str() << " "
+                       << mangledName << "\n";
+                } else {
+                    // promoted, but copy the arg, because the backend binds
+                    // the arg to its register (or stack slot) of the ABI
+                    auto argCopy = genId();
+                    os << "\t" << argCopy << " = bitcast " << paramType->str()
+                       << " " << inputArgName << " to " << paramType->str()
+                       << "\n";
+                    ssa.declare(mangledName, paramType);
+                    ssa.write(mangledName, argCopy);
+                }
             }
 
             // body // TODO test this
             auto body = reinterpret_cast<BlockAST*>(fn->body.get());
             for (auto& stmt : *body->stmts) {
-                if (stmt->type() == TType::ReturnStmtT) {
-                    hasRet = true;
-                }
                 compileStmt(os, stmt);
             }
             // ensure ret
-            auto retType = fn->getRetType();
-            if (!hasRet) {
-                if (retType == "i64") {
+            if (ssa.deadBlock()) {
+                // every path returns already
+                if (ssa.reachable()) {
+                    os << "\tunreachable\n";
+                }
+            } else {
+                if (retType->isInt()) {
                     os << "\tret i64 0\n";
-                } else if (retType == "void") {
+                } else if (retType->isVoid()) {
                     os << "\tret void\n";
                 } else {
                     cerr << "error: lack of ret in func " << fn->ident << endl;
-                    assert(false);
+                    throw CompileError();
                 }
             }
         }
-        restoreScope(re);
+        leaveScope();
 
         os << "}\n";
+        ssa.finish(_os, funcBuf.str(), entryAllocas);
     }
 
     /**
@@ -353,7 +715,10 @@ class Compiler {
         if (debug) {
             clog << ">> compileStmt " << *stmt << endl;
         }
-        stringstream ss;
+        if (!ssa.reachable() && stmt->type() != TType::EmptyStmtT) {
+            // dead code after return, break or continue
+            startBlock(os, genLabelId("dead"));
+        }
         if (stmt->type() == TType::VarSpecT) {
             auto stm = reinterpret_cast<VarSpecAST*>(stmt);
             // assert idNum == valNum or valNum == 0
@@ -363,31 +728,38 @@ class Compiler {
                 cerr
                     << "compileStmt: VarSpec ids and init vals number not match"
                     << endl;
-                assert(false);
+                throw CompileError();
             }
             for (int i = 0; i < idNum; i++) {
                 string id = stm->idents->at(i);
                 // get mangled name
-                ss << "%local_" << id << "." << varSuffix++;
-                auto mangledName = ss.str();
+                string mangledName =
+                    "%local_" + id + "." + to_string(varSuffix++);
                 // get var type
-                auto varType = stm->info();
-                if (varType == "infer") {
+                const Type* varType;
+                if (stm->btype == nullptr) {
                     varType = inferType(stm->initVals->at(i));
+                } else {
+                    varType = typeOf(stm->btype.get());
                 }
                 // insert obj into scope with LValAST node
-                auto node = new LValAST(id, varType);
-                scope->Insert(new Object(id, mangledName, node));
-                // alloc local space to store the var,
-                // and mangledName is the ptr to this place
-                os << "\t" << mangledName << " = alloca " << varType
-                   << ", align 4\n";
+                auto sym = stm->syms[i];
+                auto node = new LValAST(sym, id, varType->str());
+                scope->Insert(new Object(sym, id, mangledName, node, varType));
+                if (varType->isArray()) {
+                    // alloc local space to store the var,
+                    // and mangledName is the ptr to this place
+                    os << "\t" << mangledName << " = alloca "
+                       << varType->str() << ", align 4\n";
+                } else {
+                    // promoted, the var is just the SSA values assigned to it
+                    ssa.declare(mangledName, varType);
+                }
                 // init
                 if (valNum > 0) {
                     // init with val
                     auto valLocal = compileExpr(os, stm->initVals->at(i));
-                    os << "\tstore " << varType << " " << valLocal << ", "
-                       << increaseDim(varType) << " " << mangledName << "\n";
+                    genStore(os, varType, valLocal, mangledName);
                 } else {
                     // init with default val (zero val)
                     genDefaultInit(os, varType, mangledName);
@@ -398,18 +770,16 @@ class Compiler {
         } else if (stmt->type() == TType::IfStmtT) {
             auto stmt1 = reinterpret_cast<IfStmtAST*>(stmt);
             // if you are debugging, you can generate more labels
-            ss << labelSuffix++;
+            auto suffix = to_string(labelSuffix++);
             // for basic block?
-            auto ifInit = genLabelId("if.init" + ss.str());
-            auto ifCond = genLabelId("if.cond" + ss.str());
+            auto ifInit = genLabelId("if.init" + suffix);
+            auto ifCond = genLabelId("if.cond" + suffix);
             // the body label is just a placeholder for br
-            auto ifBody = genLabelId("if.body" + ss.str());
+            auto ifBody = genLabelId("if.body" + suffix);
             // for if-else
-            auto ifElse = genLabelId("if.else" + ss.str());
+            auto ifElse = genLabelId("if.else" + suffix);
             // for if or if-else
-            auto ifEnd = genLabelId("if.end" + ss.str());
-            // the scope out of if
-            auto outIf = scope;
+            auto ifEnd = genLabelId("if.end" + suffix);
             // enter scope in if
             // br if.init
             // os << "\tbr label %" << ifInit << "\n";
@@ -425,44 +795,38 @@ class Compiler {
                 // os << "\n" << ifCond << ":\n";
                 auto cond = compileExpr(os, stmt1->cond);
                 if (stmt1->elseBlockStmt != nullptr) {
-                    os << "\tbr i1 " << cond << ", label %" << ifBody
-                       << ", label %" << ifElse << "\n";
+                    genCondBr(os, cond, ifBody, ifElse);
                 } else {
-                    os << "\tbr i1 " << cond << ", label %" << ifBody
-                       << ", label %" << ifEnd << "\n";
+                    genCondBr(os, cond, ifBody, ifEnd);
                 }
                 // if.body
-                auto reScope1 = scope;
                 enterScope();
                 {
-                    os << "\n" << ifBody << ":\n";
+                    startBlock(os, ifBody);
                     compileStmt(os, stmt1->body);
-                    os << "\tbr label %" << ifEnd << "\n";
+                    genBr(os, ifEnd);
                 }
-                restoreScope(reScope1);
+                leaveScope();
                 // if.else
                 if (stmt1->elseBlockStmt != nullptr) {
-                    auto reScope2 = scope;
                     enterScope();
-                    os << "\n" << ifElse << ":\n";
+                    startBlock(os, ifElse);
                     compileStmt(os, stmt1->elseBlockStmt);
-                    restoreScope(reScope2);
-                    os << "\tbr label %" << ifEnd << "\n";
+                    leaveScope();
+                    genBr(os, ifEnd);
                 }
             }
             // end
-            os << "\n" << ifEnd << ":\n";
-            restoreScope(outIf);
+            startBlock(os, ifEnd);
+            leaveScope();
         } else if (stmt->type() == TType::ForStmtT) {
             auto stm = reinterpret_cast<ForStmtAST*>(stmt);
-            auto re1 = scope;
             enterScope();
-            ss << labelSuffix++;
+            labelSuffix++;
             auto forCond = stm->getLabel("cond");
             auto forBody = stm->getLabel("body");
             auto forPost = stm->getLabel("post");
             auto forEnd = stm->getLabel("end");
-            auto re2 = scope;
             enterScope();
             {
                 // os << "\n" << forInit << ":\n";
@@ -470,48 +834,49 @@ class Compiler {
                     stm->init->type() != TType::EmptyStmtT) {
                     compileStmt(os, stm->init);
                 }
-                os << "\tbr label %" << forCond << "\n";
+                auto outerRows = hoistedRows;
+                genHoistedRows(os, stm);
+                genBr(os, forCond);
 
-                // for.cond
-                os << "\n" << forCond << ":\n";
+                // for.cond, sealed after the back edge from for.post
+                startBlock(os, forCond, false);
                 if (stm->cond != nullptr &&
                     stm->cond->type() != TType::EmptyStmtT) {
                     auto cond = compileExpr(os, stm->cond);
-                    os << "\tbr i1 " << cond << ", label %" << forBody
-                       << ", label %" << forEnd << "\n";
+                    genCondBr(os, cond, forBody, forEnd);
                 } else {
-                    os << "\tbr label %" << forBody << "\n";
+                    genBr(os, forBody);
                 }
                 // for.body
-                auto re3 = scope;
                 enterScope();
                 {
-                    os << "\n" << forBody << ":\n";
+                    startBlock(os, forBody);
                     compileStmt(os, stm->body);
-                    os << "\tbr label %" << forPost << "\n";
+                    genBr(os, forPost);
                 }
-                restoreScope(re3);
+                leaveScope();
                 // for.post
                 {
-                    os << "\n" << forPost << ":\n";
+                    startBlock(os, forPost);
                     if (stm->post != nullptr &&
                         stm->post->type() != TType::EmptyStmtT) {
                         compileStmt(os, stm->post);
                     }
-                    os << "\tbr label %" << forCond << "\n";
+                    genBr(os, forCond);
                 }
+                ssa.seal(forCond);
+                hoistedRows = outerRows;
             }
-            restoreScope(re2);
-            os << "\n" << forEnd << ":\n";
-            restoreScope(re1);
+            leaveScope();
+            startBlock(os, forEnd);
+            leaveScope();
         } else if (stmt->type() == TType::BlockT) {
             auto stmt3 = reinterpret_cast<BlockAST*>(stmt);
-            auto re = scope;
             enterScope();
             for (auto& stmt : *stmt3->stmts) {
                 compileStmt(os, stmt);
             }
-            restoreScope(re);
+            leaveScope();
         } else if (stmt->type() == TType::ExpStmtT) {
             auto stmt4 = reinterpret_cast<ExpStmtAST*>(stmt);
             compileExpr(os, stmt4->exp);
@@ -524,8 +889,9 @@ class Compiler {
                 // TODO hard type check: return type should be the same as function
                 auto ret = compileExpr(os, stm->exp);
                 auto retType = inferType(stm->exp);
-                os << "\tret " << retType << " " << ret << "\n";
+                os << "\tret " << retType->str() << " " << ret << "\n";
             }
+            ssa.terminate();
         } else if (stmt->type() == TType::BranchStmtT) {
             auto stm = reinterpret_cast<BranchStmtAST*>(stmt);
             string labelSuffix = "";
@@ -548,36 +914,80 @@ class Compiler {
                 // the label
                 label = forStmt->getLabel(labelSuffix);
             }
-            os << "\tbr label %" << label << "\n";
+            genBr(os, label);
         } else if (stmt->type() == TType::EmptyStmtT) {
             // do nothing
         } else if (stmt->type() == TType::IncDecStmtT) {
             auto stmt6 = reinterpret_cast<IncDecStmtAST*>(stmt);
             auto tar = reinterpret_cast<LValAST*>(stmt6->target.get());
-            auto obj = scope->Lookup(tar->ident).second;
+            auto obj = scope->Lookup(tar->sym);
             string op = stmt6->isInc ? "add" : "sub";
             if (obj == nullptr) {
                 cerr << "IncDecStmt: undefined variable: " << tar->ident
                      << endl;
-                assert(false);
+                throw CompileError();
             }
             auto varMName = obj->MangledName;
-            if (obj->Node->info() != "i64") {
+            if (!obj->Ty->isInt()) {
                 // TODO not support a[x]++
                 cerr << "IncDecStmt: not support array" << endl;
-                assert(false);
+                throw CompileError();
             }
-            auto val = genId();
-            os << "\t" << val << " = load i64, i64* " << varMName
-               << ", align 4\n";
+            auto val = genLoad(os, obj->Ty, varMName);
             auto newVal = genId();
             os << "\t" << newVal << " = " << op << " i64 " << val << ", "
                << "1" << endl;
-            os << "\tstore i64 " << newVal << ", i64* " << varMName
-               << ", align 4\n";
+            genStore(os, obj->Ty, newVal, varMName);
         } else {
             cerr << "unknown stmt type" << endl;
-            assert(false);
+            throw CompileError();
+        }
+    }
+
+    /**
+     * @brief load the invariant rows of the loop before it, in for.pre
+     * @note for.pre is only entered if the cond is true at first, so that the
+     * rows are loaded only if the first iteration loads them anyway, and the
+     * cond is evaluated twice, so it must have no call:
+     * 
+     *   br i1 %cond, label %for.pre, label %for.end
+     * for.pre:
+     *   ... (the rows)
+     *   br label %for.cond
+     * 
+     * @param os the ostream to write to
+     * @param stm the ForStmtAST, whose init is compiled
+     */
+    void genHoistedRows(ostream& os, ForStmtAST* stm) {
+        if (!ssa.reachable()) {
+            return;
+        }
+        vector<pair<string, pair<LValAST*, int>>> rows;
+        LoopInvariants invariants(scope, stm);
+        for (auto& row : invariants.Rows()) {
+            if (!hoistedRows.count(row.first)) {
+                rows.push_back(row);
+            }
+        }
+        if (rows.empty()) {
+            return;
+        }
+        auto forPre = stm->getLabel("pre");
+        if (stm->cond != nullptr && stm->cond->type() != TType::EmptyStmtT) {
+            // invariant: the cond is compiled again here, before for.cond,
+            // which is only right as it has no side effect, i.e. no call but
+            // builtins, and LoopInvariants hoists no row if there is a call
+            assert(!invariants.HasCall());
+            auto cond = compileExpr(os, stm->cond);
+            genCondBr(os, cond, forPre, stm->getLabel("end"));
+        } else {
+            genBr(os, forPre);
+        }
+        startBlock(os, forPre);
+        for (auto& [key, row] : rows) {
+            auto [lval, k] = row;
+            auto [ptrName, rowType] = genElemPtr(os, lval, k);
+            hoistedRows[key] = genLoad(os, rowType, ptrName);
         }
     }
 
@@ -593,7 +1003,7 @@ class Compiler {
         auto& targets = *stmt->targets;
         auto& initVals = *stmt->initVals;
         vector<string> valueNameList(initVals.size());
-        vector<string> valueTypeList(initVals.size());
+        vector<const Type*> valueTypeList(initVals.size());
         for (int i = 0; i < (*stmt->targets).size(); ++i) {
             valueNameList[i] = compileExpr(os, initVals[i]);
             valueTypeList[i] = inferType(initVals[i]);
@@ -601,77 +1011,56 @@ class Compiler {
         if (stmt->isDefine == true) {
             for (int i = 0; i < targets.size(); ++i) {
                 auto tar = reinterpret_cast<LValAST*>(targets[i].get());
-                if (!scope->HasName(tar->ident)) {
-                    stringstream ss;
-                    ss << "%local_" << tar->ident << "." << varSuffix++;
-                    auto mangledName = ss.str();
+                if (!scope->HasName(tar->sym)) {
+                    auto mangledName =
+                        numbered("%local_" + tar->ident + ".", varSuffix++);
                     auto varType = inferType(initVals[i]);
                     // give the inserted node (LValAST) info of its type
-                    tar->typeInfo = varType;
-                    scope->Insert(new Object(tar->ident, mangledName, tar));
-                    os << "\t" << mangledName << " = alloca " << varType
-                       << ", align 4\n";
+                    tar->typeInfo = varType->str();
+                    scope->Insert(
+                        new Object(tar->sym, tar->ident, mangledName, tar,
+                                   varType));
+                    if (varType->isArray()) {
+                        os << "\t" << mangledName << " = alloca "
+                           << varType->str() << ", align 4\n";
+                    } else {
+                        ssa.declare(mangledName, varType);
+                    }
                 }
             }
         }
         for (int i = 0; i < targets.size(); ++i) {
             auto tar = reinterpret_cast<LValAST*>(targets[i].get());
             string varMName = "";
-            auto obj = scope->Lookup(tar->ident).second;
+            auto obj = scope->Lookup(tar->sym);
             if (obj != nullptr) {
                 varMName = obj->MangledName;
             } else {
                 cerr << "var " << tar->ident << " undefined" << endl;
-                assert(false);
+                throw CompileError();
             }
-            auto varType = obj->Node->info();
+            auto varType = obj->Ty;
             // to support index (tar->indexList)
             if (tar->indexList == nullptr) {
                 cerr << "compileStmt_assign: indexList is null" << endl;
-                assert(false);
+                throw CompileError();
             } else if (tar->indexList->empty()) {
                 // assert type match
                 if (!typeMatch(varType, valueTypeList[i])) {
                     cerr << "compileStmt_assign: varType != valueTypeList[i]"
                          << endl;
-                    assert(false);
+                    throw CompileError();
                 }
-                os << "\tstore " << valueTypeList[i] << " " << valueNameList[i]
-                   << ", " << increaseDim(valueTypeList[i]) << " " << varMName
-                   << "\n";
+                genStore(os, varType, valueNameList[i], varMName);
             } else {
-                // get %arrayidx
-                string ptrName = varMName;
-                string curType = varType;
-                for (int j = 0; j < tar->indexList->size(); ++j) {
-                    auto& idxExp = tar->indexList->at(j);
-                    auto idxName = compileExpr(os, idxExp);
-                    // assert idxExp is int, type checking
-                    if (inferType(idxExp) != "i64") {
-                        cerr << "compileStmt_assign: index expression is "
-                                "not int"
-                             << endl;
-                        assert(false);
-                    }
-                    string ptrValName = genId();
-                    os << "\t" << ptrValName << " = load " << curType << ", "
-                       << increaseDim(curType) << " " << ptrName << ", align 4"
-                       << endl;
-                    string nextPtrName = genId();
-                    string redCurType = reduceDim(curType);
-                    os << "\t" << nextPtrName << " = getelementptr inbounds "
-                       << redCurType << ", " << curType << " " << ptrValName
-                       << ", i64 " << idxName << "\n";
-                    ptrName = nextPtrName;
-                    curType = redCurType;
-                }
+                auto [ptrName, curType] =
+                    genElemPtr(os, tar, tar->indexList->size());
                 // assert valueType match curType, type checking
                 if (!typeMatch(curType, valueTypeList[i])) {
                     cerr << "compileStmt_assign: valueType != curType" << endl;
-                    assert(false);
+                    throw CompileError();
                 }
-                os << "\tstore " << valueTypeList[i] << " " << valueNameList[i]
-                   << ", " << increaseDim(curType) << " " << ptrName << "\n";
+                genStore(os, curType, valueNameList[i], ptrName);
             }
         }
     }
@@ -692,65 +1081,44 @@ class Compiler {
         string localName;  // ret
         if (expr->type() == TType::LValT) {
             auto exp = reinterpret_cast<LValAST*>(expr);
-            auto obj = scope->Lookup(exp->ident).second;
+            auto obj = scope->Lookup(exp->sym);
             if (obj == nullptr) {
                 cerr << "var " << exp->ident << " undefined" << endl;
-                assert(false);
+                throw CompileError();
             }
             auto varMName = obj->MangledName;
-            auto varType = obj->Node->info();
+            auto varType = obj->Ty;
             // to support index (exp->indexList)
             if (exp->indexList == nullptr) {
                 cerr << "compileExpr: indexList is null" << endl;
-                assert(false);
+                throw CompileError();
             } else if (exp->indexList->empty()) {
-                localName = genId();
-                os << "\t" << localName << " = load " << varType << ", "
-                   << increaseDim(varType) << " " << varMName << ", align 4\n";
+                localName = genLoad(os, varType, varMName);
             } else {
-                // get %arrayidx
-                auto ptrName = varMName;
-                auto curType = varType;
-                for (int j = 0; j < exp->indexList->size(); ++j) {
-                    auto& idxExp = exp->indexList->at(j);
-                    auto idxName = compileExpr(os, idxExp);
-                    // assert idxExp is int, type checking
-                    if (inferType(idxExp) != "i64") {
-                        cerr << "compileExpr: index expression is not int"
-                             << endl;
-                        assert(false);
+                if (!hoistedRows.empty()) {
+                    auto it = hoistedRows.find(LoopInvariants::Key(
+                        scope, exp, exp->indexList->size()));
+                    if (it != hoistedRows.end()) {
+                        return it->second;
                     }
-                    string ptrValName = genId();
-                    os << "\t" << ptrValName << " = load " << curType << ", "
-                       << increaseDim(curType) << " " << ptrName << ", align 4"
-                       << endl;
-                    string nextPtrName = genId();
-                    string redCurType = reduceDim(curType);
-                    os << "\t" << nextPtrName << " = getelementptr inbounds "
-                       << redCurType << ", " << curType << " " << ptrValName
-                       << ", i64 " << idxName << "\n";
-                    ptrName = nextPtrName;
-                    curType = redCurType;
                 }
-                localName = genId();
-                os << "\t" << localName << " = load " << curType << ", "
-                   << increaseDim(curType) << " " << ptrName << ", align 4\n";
+                auto [ptrName, curType] =
+                    genElemPtr(os, exp, exp->indexList->size());
+                localName = genLoad(os, curType, ptrName);
             }
             return localName;
         } else if (expr->type() == TType::NilT) {
             // llvm const
             return "null";
         } else if (expr->type() == TType::NumberT) {
+            // an immediate, used as the operand directly
             auto exp = reinterpret_cast<NumberAST*>(expr);
-            localName = genId();
-            os << "\t" << localName << " = "
-               << "add"
-               << " i64 "
-               << "0"
-               << ", " << exp->num << endl;
-            return localName;
+            return to_string(exp->num);
         } else if (expr->type() == TType::BinExpT) {
             auto exp = reinterpret_cast<BinExpAST*>(expr);
+            if (exp->op == BinExpAST::Op::AND || exp->op == BinExpAST::Op::OR) {
+                return compileExpr_logic(os, exp);
+            }
             localName = genId();
             if (debug) {
                 clog << ">> doing left" << endl;
@@ -771,13 +1139,13 @@ class Compiler {
                            typeMatch(rightType, leftType);
             if (!isMatch) {
                 cerr << "compileExpr: type mismatch" << endl;
-                cerr << " - left: " << leftType << ", right: " << rightType
-                     << endl;
+                cerr << " - left: " << leftType->str()
+                     << ", right: " << rightType->str() << endl;
                 cerr << " - ast: " << *exp << endl;
-                assert(false);
+                throw CompileError();
             }
             // get type of result
-            string finalType = leftType;
+            auto finalType = leftType;
             if (isPtr(leftType)) {
                 // assert op is EQ or NE
                 if (exp->op != BinExpAST::Op::EQ &&
@@ -786,11 +1154,11 @@ class Compiler {
                         << "compileExpr: pointers can only be compared with EQ "
                            "or NE"
                         << endl;
-                    assert(false);
+                    throw CompileError();
                 }
             }
             // result cannot be nil (if both nil), just return true
-            if (finalType == "nil") {
+            if (finalType->isNil()) {
                 os << "\t" << localName << " = "
                    << "add"
                    << " i64 "
@@ -803,83 +1171,73 @@ class Compiler {
                 case BinExpAST::Op::ADD:
                     os << "\t" << localName << " = "
                        << "add"
-                       << " " << finalType << " " << left << ", " << right
+                       << " " << finalType->str() << " " << left << ", " << right
                        << endl;
                     break;
                 case BinExpAST::Op::SUB:
                     os << "\t" << localName << " = "
                        << "sub"
-                       << " " << finalType << " " << left << ", " << right
+                       << " " << finalType->str() << " " << left << ", " << right
                        << endl;
                     break;
                 case BinExpAST::Op::MUL:
                     os << "\t" << localName << " = "
                        << "mul"
-                       << " " << finalType << " " << left << ", " << right
+                       << " " << finalType->str() << " " << left << ", " << right
                        << endl;
                     break;
                 case BinExpAST::Op::DIV:
                     os << "\t" << localName << " = "
                        << "sdiv"
-                       << " " << finalType << " " << left << ", " << right
+                       << " " << finalType->str() << " " << left << ", " << right
                        << endl;
                     break;
                 case BinExpAST::Op::MOD:
                     os << "\t" << localName << " = "
                        << "srem"
-                       << " " << finalType << " " << left << ", " << right
+                       << " " << finalType->str() << " " << left << ", " << right
                        << endl;
                     break;
                     // https://llvm.org/docs/LangRef.html#icmp-instruction
                 case BinExpAST::Op::EQ:
                     os << "\t" << localName << " = "
                        << "icmp eq"
-                       << " " << finalType << " " << left << ", " << right
+                       << " " << finalType->str() << " " << left << ", " << right
                        << endl;
                     break;
                 case BinExpAST::Op::NE:
                     os << "\t" << localName << " = "
                        << "icmp ne"
-                       << " " << finalType << " " << left << ", " << right
+                       << " " << finalType->str() << " " << left << ", " << right
                        << endl;
                     break;
                 case BinExpAST::Op::LT:
                     os << "\t" << localName << " = "
                        << "icmp slt"
-                       << " " << finalType << " " << left << ", " << right
+                       << " " << finalType->str() << " " << left << ", " << right
                        << endl;
                     break;
                 case BinExpAST::Op::LE:
                     os << "\t" << localName << " = "
                        << "icmp sle"
-                       << " " << finalType << " " << left << ", " << right
+                       << " " << finalType->str() << " " << left << ", " << right
                        << endl;
                     break;
                 case BinExpAST::Op::GT:
                     os << "\t" << localName << " = "
                        << "icmp sgt"
-                       << " " << finalType << " " << left << ", " << right
+                       << " " << finalType->str() << " " << left << ", " << right
                        << endl;
                     break;
                 case BinExpAST::Op::GE:
                     os << "\t" << localName << " = "
                        << "icmp sge"
-                       << " " << finalType << " " << left << ", " << right
+                       << " " << finalType->str() << " " << left << ", " << right
                        << endl;
                     break;
-                case BinExpAST::Op::AND:
-                    os << "\t" << localName << " = "
-                       << "and"
-                       << " i1 " << left << ", " << right << endl;
-                    break;
-                case BinExpAST::Op::OR:
-                    os << "\t" << localName << " = "
-                       << "or"
-                       << " i1 " << left << ", " << right << endl;
-                    break;
                 default:
                     cerr << "compileExpr: unknown type of BinExpAST" << endl;
-                    assert(false);
+                    throw CompileError();
                     break;
             }
             if (debug) {
@@ -904,85 +1262,33 @@ class Compiler {
             return compileExpr(os, exp->p);
         } else if (expr->type() == TType::MakeExpT) {
             auto exp = reinterpret_cast<MakeExpAST*>(expr);
-            auto varType = exp->info();
+            auto varType = inferType(_expr);
             // assert varType is array
-            if (varType == "i64") {
+            if (varType->isInt()) {
                 cerr << "compileExpr: make type is not array" << endl;
-                assert(false);
+                throw CompileError();
             }
             // assert len is int, maybe error while eval-ing
-            if (inferType(exp->len) != "i64") {
+            if (!inferType(exp->len)->isInt()) {
                 cerr << "compileExpr: make len must be int" << endl;
-                assert(false);
+                throw CompileError();
             }
             string lenLocal = compileExpr(os, exp->len);
-            auto localName = genId();
-            {  // alloca on stack
-                // os << "\t" << localName << " = "
-                //    << "alloca " << varType << ", i64 " << lenLocal
-                //    << ", align 4" << endl;
-            }
-            // alloca on heap, call malloc
-            // get size of element type
-            auto elemType = reduceDim(varType);
-            auto elemSize = 8;  // ptr in x86_64 machine
-            if (elemType == "i64") {
-                elemSize = 8;  // x64
-            } else if (elemType == "i32") {
-                elemSize = 4;  // int
-            }
-            // get size of array
-            auto sizeLocal = genId();
-            os << "\t" << sizeLocal << " = "
-               << "mul"
-               << " i64 " << lenLocal << ", " << to_string(elemSize) << endl;
-            // call malloc which returns i8*
-            auto i8pName = genId();
-            auto i8pType = "i8*";
-            os << "\t" << i8pName << " = "
-               << "call noalias " << i8pType << " @malloc(i64 " << sizeLocal
-               << ")" << endl;
-            // convert the ptr type with bitcast
-            os << "\t" << localName << " = "
-               << "bitcast " << i8pType << " " << i8pName << " to " << varType
-               << endl;
-            return localName;
+            // zeroed as Go does
+            return genArrayAlloc(os, varType, lenLocal, exp->onStack, true);
         } else if (expr->type() == TType::ArrayExpT) {
             auto exp = reinterpret_cast<ArrayExpAST*>(expr);
-            auto varType = exp->info();
+            auto varType = inferType(_expr);
             // assert varType is array
-            if (varType == "i64") {
+            if (varType->isInt()) {
                 cerr << "compileExpr: array exp type is not array" << endl;
-                assert(false);
-            }
-            auto localName = genId();
-            {  // alloca on stack
-                // os << "\t" << localName << " = "
-                //    << "alloca " << varType << ", i64 " << elemNum
-                //    << ", align 4" << endl;
+                throw CompileError();
             }
-            // alloca on heap, call malloc
-            // get size of element type
             auto elemType = reduceDim(varType);
-            auto elemSize = 8;  // ptr in x86_64 machine
-            if (elemType == "i64") {
-                elemSize = 8;  // x64
-            } else if (elemType == "i32") {
-                elemSize = 4;  // int
-            }
-            // get size of array
             int elemNum = exp->initValList->size();
-            auto arrSize = elemNum * elemSize;
-            // call malloc which returns i8*
-            auto i8pName = genId();
-            auto i8pType = "i8*";
-            os << "\t" << i8pName << " = "
-               << "call noalias " << i8pType << " @malloc(i64 "
-               << to_string(arrSize) << ")" << endl;
-            // convert the ptr type with bitcast
-            os << "\t" << localName << " = "
-               << "bitcast " << i8pType << " " << i8pName << " to " << varType
-               << endl;
+            auto localName =
+                genArrayAlloc(os, varType, to_string(elemNum), exp->onStack,
+                              false);
             // get and store each element
             for (int i = 0; i < elemNum; i++) {
                 auto initValLocal = compileExpr(os, exp->initValList->at(i));
@@ -990,38 +1296,42 @@ class Compiler {
                 // check type
                 if (!typeMatch(elemType, initValType)) {
                     cerr << "compileExpr: array exp type mismatch" << endl;
-                    assert(false);
+                    throw CompileError();
                 }
                 auto idxLocal = to_string(i);
                 auto elemPtrLocal = genId();
                 // here varType is usually elemType*
                 os << "\t" << elemPtrLocal << " = "
-                   << "getelementptr inbounds " << elemType << ", " << varType
-                   << " " << localName << ", i64 " << idxLocal << endl;
+                   << "getelementptr inbounds " << elemType->str() << ", "
+                   << varType->str() << " " << localName << ", i64 " << idxLocal
+                   << endl;
                 os << "\t"
-                   << "store " << elemType << " " << initValLocal << ", "
-                   << increaseDim(elemType) << " " << elemPtrLocal << endl;
+                   << "store " << elemType->str() << " " << initValLocal << ", "
+                   << increaseDim(elemType)->str() << " " << elemPtrLocal
+                   << endl;
             }
             return localName;
         } else if (expr->type() == TType::CallExpT) {
             auto exp = reinterpret_cast<CallExpAST*>(expr);
-            auto obj = scope->Lookup(exp->funcName).second;
+            auto obj = scope->Lookup(exp->sym);
             string funcName;
             if (obj != nullptr) {
                 funcName = obj->MangledName;
             } else {
                 cerr << "compileExpr: function " << exp->funcName
                      << " undefined" << endl;
-                assert(false);
+                throw CompileError();
             }
-            auto funcDefAST = reinterpret_cast<FuncDefAST*>(obj->Node);
+            if (obj->Node->type() == TType::BuiltinFuncT) {
+                return compileBuiltin(os, exp);
+            }
+            auto funcType = reinterpret_cast<const FuncType*>(obj->Ty);
             int argNum = exp->argList->size();
             // get return type and param types
-            auto paramTypes = funcDefAST->getParamTypes();
-            string funcType = funcDefAST->info();
+            auto& paramTypes = funcType->params;
             // args
             vector<string> argNames;
-            vector<string> argTypes;
+            vector<const Type*> argTypes;
             for (int i = 0; i < argNum; i++) {
                 auto argName = compileExpr(os, exp->argList->at(i));
                 argNames.push_back(argName);
@@ -1029,37 +1339,37 @@ class Compiler {
                 argTypes.push_back(argType);
             }
             // no localName if return void
-            auto returnType = funcDefAST->getRetType();
-            stringstream sub;
-            if (returnType == "void") {
+            auto returnType = funcType->ret;
+            os << "\t";
+            if (returnType->isVoid()) {
                 localName = "";
-                sub << localName;
             } else {
                 localName = genId();
-                sub << localName << " = ";
+                os << localName << " = ";
             }
-            os << "\t" << sub.str() << "call " << funcType << " " << funcName
-               << "(";
+            os << "call " << funcType->str() << " " << funcName << "(";
             for (int i = 0; i < argNum; i++) {
                 // type check for param and arg
-                if (!typeMatch(paramTypes->at(i), argTypes[i])) {
+                if (!typeMatch(paramTypes[i], argTypes[i])) {
                     cerr << "compileExpr: type mismatch in function call - "
                          << funcName << endl;
                     // show the arg type and param type
-                    cerr << " - arg has type \"" << argTypes[i]
-                         << "\", but expected \"" << paramTypes->at(i) << "\"."
-                         << endl;
+                    cerr << " - arg has type \"" << argTypes[i]->str()
+                         << "\", but expected \"" << paramTypes[i]->str()
+                         << "\"." << endl;
                     cerr << " - arg AST: " << *exp->argList->at(i) << endl;
-                    assert(false);
+                    throw CompileError();
                 }
-                os << paramTypes->at(i) << " " << argNames[i];
+                os << paramTypes[i]->str() << " " << argNames[i];
                 if (i != argNum - 1) os << ", ";
             }
             os << ")" << endl;
+            // the callee may store anything
+            loadCache.clear();
             return localName;
         } else {
             cerr << "compileExpr: unknown type of ExpAST" << endl;
-            assert(false);
+            throw CompileError();
         }
         if (debug) {
             clog << ">> compileExpr: done, localName: " << localName << endl;
@@ -1068,49 +1378,334 @@ class Compiler {
     }
 
     /**
-     * @brief reduce dimension of array type
+     * @brief compile a call of len() or cap()
+     * @note the len of [N]T is N, and that of nil is 0, otherwise it is loaded
+     * from the header of the array:
      * 
-     * @param t the type string
-     * @return string - the reduced type string
+     *   %p = bitcast T* %s to i64*
+     *   %c = icmp eq i64* %p, null
+     *   br i1 %c, label %len.nil, label %len.load
+     * len.nil:
+     *   br label %len.end
+     * len.load:
+     *   %h = getelementptr inbounds i64, i64* %p, i64 -2
+     *   %l = load i64, i64* %h
+     *   br label %len.end
+     * len.end:
+     *   %t = phi i64 [ 0, %len.nil ], [ %l, %len.load ]
      * 
-     * @note change "[5 x [4 x i64]]" to "[4 x i64]"
-     * @note change "i64**" to "i64*"
+     * @param os the ostream to write to
+     * @param exp the CallExpAST of the builtin
+     * @return string - the i64 result
      */
-    string reduceDim(string t) {
-        int i = 0;
-        while (i < t.size() && t[i] != 'x') i++;
-        if (i == t.size()) {
-            if (t.find("*") != string::npos) {
-                return t.substr(0, t.size() - 1);
-            } else {
-                cerr << "reduceDim: not an array type" << endl;
-                assert(false);
+    string compileBuiltin(ostream& os, CallExpAST* exp) {
+        auto& name = exp->funcName;
+        if (exp->argList->size() != 1) {
+            cerr << "compileBuiltin: " << name << " takes 1 arg" << endl;
+            throw CompileError();
+        }
+        auto& arg = exp->argList->at(0);
+        auto argType = inferType(arg);
+        if (argType->isArray()) {
+            return to_string(reinterpret_cast<const ArrayType*>(argType)->len);
+        } else if (argType->isNil()) {
+            return "0";
+        } else if (!argType->isPtr()) {
+            cerr << "compileBuiltin: invalid arg of " << name << " - "
+                 << argType->str() << endl;
+            throw CompileError();
+        }
+        auto arr = compileExpr(os, arg);
+        if (arr == "null") {
+            // like a var that is never assigned
+            return "0";
+        }
+        // the offset of the field in the header
+        int offset = (name == "len" ? 0 : 1) - arrayHeaderWords;
+        auto base = arr;
+        if (argType != types.PointerTo(types.Int())) {
+            base = genId();
+            os << "\t" << base << " = bitcast " << argType->str() << " " << arr
+               << " to i64*" << endl;
+        }
+        auto nilLabel = genLabelId(name + ".nil");
+        auto loadLabel = genLabelId(name + ".load");
+        auto endLabel = genLabelId(name + ".end");
+        auto isNil = genId();
+        os << "\t" << isNil << " = icmp eq i64* " << base << ", null" << endl;
+        genCondBr(os, isNil, nilLabel, loadLabel);
+        startBlock(os, nilLabel);
+        genBr(os, endLabel);
+        startBlock(os, loadLabel);
+        auto fieldPtr = genId();
+        os << "\t" << fieldPtr << " = getelementptr inbounds i64, i64* " << base
+           << ", i64 " << offset << endl;
+        auto field = genId();
+        os << "\t" << field << " = load i64, i64* " << fieldPtr << endl;
+        genBr(os, endLabel);
+        startBlock(os, endLabel);
+        auto localName = genId();
+        os << "\t" << localName << " = phi i64 [ 0, %" << nilLabel << " ], [ "
+           << field << ", %" << loadLabel << " ]" << endl;
+        return localName;
+    }
+
+    /**
+     * @brief compile a && or || expression with short-circuit evaluation
+     * @note the right operand is skipped by a br, and the result is a phi:
+     * 
+     *   br i1 %l, label %land.rhs, label %land.false
+     * land.rhs:
+     *   ... (%r)
+     *   br label %land.end
+     * land.false:
+     *   br label %land.end
+     * land.end:
+     *   %t = phi i1 [ %r, %land.rhs ], [ false, %land.false ]
+     * 
+     * @note for ||, lor.true goes before lor.rhs, so that the first label of
+     * the br is always the next line, which Backend.py relies on
+     * 
+     * @param os the ostream to write to
+     * @param exp the BinExpAST with op AND or OR
+     * @return string - the i1 result
+     */
+    string compileExpr_logic(ostream& os, BinExpAST* exp) {
+        bool isAnd = exp->op == BinExpAST::Op::AND;
+        if (exp->left->type() == TType::NumberT) {
+            // folded left operand, no br needed
+            auto left = reinterpret_cast<NumberAST*>(exp->left.get())->num;
+            if ((left != 0) == isAnd) {
+                return compileExpr(os, exp->right);
             }
+            return isAnd ? "0" : "1";
         }
-        int j = t.size() - 1;
-        while (j >= 0 && t[j] != ']') j--;
-        if (j == -1) {
-            if (t.find("*") != string::npos) {
-                return t.substr(0, t.size() - 1);
-            } else {
-                cerr << "reduceDim: not an array type" << endl;
-                assert(false);
+        string prefix = isAnd ? "land" : "lor";
+        auto rhsLabel = genLabelId(prefix + ".rhs");
+        auto shortLabel = genLabelId(prefix + (isAnd ? ".false" : ".true"));
+        auto endLabel = genLabelId(prefix + ".end");
+        auto left = compileExpr(os, exp->left);
+        string right;
+        string rightEnd;
+        if (isAnd) {
+            genCondBr(os, left, rhsLabel, shortLabel);
+            startBlock(os, rhsLabel);
+            right = compileExpr(os, exp->right);
+            rightEnd = ssa.currentLabel();
+            genBr(os, endLabel);
+            startBlock(os, shortLabel);
+            genBr(os, endLabel);
+        } else {
+            genCondBr(os, left, shortLabel, rhsLabel);
+            startBlock(os, shortLabel);
+            genBr(os, endLabel);
+            startBlock(os, rhsLabel);
+            right = compileExpr(os, exp->right);
+            rightEnd = ssa.currentLabel();
+            genBr(os, endLabel);
+        }
+        startBlock(os, endLabel);
+        auto localName = genId();
+        os << "\t" << localName << " = phi i1 [ " << right << ", %" << rightEnd
+           << " ], [ " << (isAnd ? "false" : "true") << ", %" << shortLabel
+           << " ]\n";
+        return localName;
+    }
+
+    /**
+     * @brief fold the const expressions in the whole file
+     * @note done before compiling, so that compileExpr sees NumberASTs
+     * 
+     * @param file the CompUnitAST (file) to fold
+     */
+    void foldFile(CompUnitAST* file) {
+        for (auto& g : file->Globals) {
+            for (auto& initVal : *g->initVals) {
+                foldExpr(initVal);
+            }
+        }
+        for (auto& fn : file->Funcs) {
+            if (fn->body != nullptr) {
+                foldStmt(fn->body);
             }
         }
-        string res = t.substr(i + 2, j - i - 2);
-        return res;
     }
 
+    /**
+     * @brief fold the const expressions in a statement
+     * 
+     * @param _stmt the StmtAST (or BlockAST) to fold
+     */
+    void foldStmt(pAST& _stmt) {
+        auto stmt = _stmt.get();
+        if (stmt->type() == TType::VarSpecT) {
+            auto stm = reinterpret_cast<VarSpecAST*>(stmt);
+            for (auto& initVal : *stm->initVals) {
+                foldExpr(initVal);
+            }
+        } else if (stmt->type() == TType::ShortVarDeclT) {
+            auto stm = reinterpret_cast<ShortVarDeclAST*>(stmt);
+            for (auto& tar : *stm->targets) {
+                foldExpr(tar);
+            }
+            for (auto& initVal : *stm->initVals) {
+                foldExpr(initVal);
+            }
+        } else if (stmt->type() == TType::IfStmtT) {
+            auto stm = reinterpret_cast<IfStmtAST*>(stmt);
+            if (stm->init != nullptr) {
+                foldStmt(stm->init);
+            }
+            foldExpr(stm->cond);
+            foldStmt(stm->body);
+            if (stm->elseBlockStmt != nullptr) {
+                foldStmt(stm->elseBlockStmt);
+            }
+        } else if (stmt->type() == TType::ForStmtT) {
+            auto stm = reinterpret_cast<ForStmtAST*>(stmt);
+            foldStmt(stm->init);
+            foldExpr(stm->cond);
+            foldStmt(stm->post);
+            foldStmt(stm->body);
+        } else if (stmt->type() == TType::BlockT) {
+            auto stm = reinterpret_cast<BlockAST*>(stmt);
+            for (auto& s : *stm->stmts) {
+                foldStmt(s);
+            }
+        } else if (stmt->type() == TType::ExpStmtT) {
+            foldExpr(reinterpret_cast<ExpStmtAST*>(stmt)->exp);
+        } else if (stmt->type() == TType::ReturnStmtT) {
+            auto stm = reinterpret_cast<ReturnStmtAST*>(stmt);
+            if (stm->exp != nullptr) {
+                foldExpr(stm->exp);
+            }
+        } else if (stmt->type() == TType::IncDecStmtT) {
+            foldExpr(reinterpret_cast<IncDecStmtAST*>(stmt)->target);
+        }
+        // BranchStmt and EmptyStmt have nothing to fold
+    }
+
+    /**
+     * @brief fold the const sub-expressions of an expression
+     * @note a const BinExpAST/UnaryExpAST/ParenExpAST is replaced in place
+     * by a NumberAST of its value from ExpAST::eval
+     * 
+     * @param _expr the ExpAST to fold
+     * @return true if the expression is const
+     * @return false 
+     */
+    bool foldExpr(pAST& _expr) {
+        auto expr = _expr.get();
+        bool isConst = false;
+        if (expr->type() == TType::NumberT) {
+            return true;
+        } else if (expr->type() == TType::ParenExpT) {
+            isConst = foldExpr(reinterpret_cast<ParenExpAST*>(expr)->p);
+        } else if (expr->type() == TType::UnaryExpT) {
+            isConst = foldExpr(reinterpret_cast<UnaryExpAST*>(expr)->p);
+        } else if (expr->type() == TType::BinExpT) {
+            auto exp = reinterpret_cast<BinExpAST*>(expr);
+            bool leftConst = foldExpr(exp->left);
+            bool rightConst = foldExpr(exp->right);
+            isConst = leftConst && rightConst;
+            if (isConst && (exp->op == BinExpAST::Op::DIV ||
+                            exp->op == BinExpAST::Op::MOD)) {
+                // leave the error or overflow to the runtime
+                auto l = reinterpret_cast<NumberAST*>(exp->left.get())->num;
+                auto r = reinterpret_cast<NumberAST*>(exp->right.get())->num;
+                if (r == 0 || (l == INT64_MIN && r == -1)) {
+                    isConst = false;
+                }
+            }
+        } else if (expr->type() == TType::LValT) {
+            for (auto& idx : *reinterpret_cast<LValAST*>(expr)->indexList) {
+                foldExpr(idx);
+            }
+        } else if (expr->type() == TType::CallExpT) {
+            for (auto& arg : *reinterpret_cast<CallExpAST*>(expr)->argList) {
+                foldExpr(arg);
+            }
+        } else if (expr->type() == TType::MakeExpT) {
+            foldExpr(reinterpret_cast<MakeExpAST*>(expr)->len);
+        } else if (expr->type() == TType::ArrayExpT) {
+            auto exp = reinterpret_cast<ArrayExpAST*>(expr);
+            for (auto& initVal : *exp->initValList) {
+                foldExpr(initVal);
+            }
+        }
+        if (isConst) {
+            auto num = new NumberAST(reinterpret_cast<ExpAST*>(expr)->eval());
+            num->setParent(expr->getParent());
+            _expr.reset(num);
+        }
+        return isConst;
+    }
+
+    /**
+     * @brief get the type of a BTypeAST
+     * 
+     * @param btype the BTypeAST
+     * @return const Type*
+     * 
+     * @note [10][10][]int is "[10 x [10 x i64*]]"
+     */
+    const Type* typeOf(BaseAST* btype) {
+        auto ast = reinterpret_cast<BTypeAST*>(btype);
+        if (ast->elementType == "void") {
+            return types.Void();
+        } else if (ast->elementType != "int") {
+            cerr << "typeOf: unknown element type" << endl;
+            throw CompileError();
+        }
+        auto t = types.Int();
+        if (ast->dims != nullptr) {
+            for (auto& dim : *ast->dims) {
+                if (dim == -1) {
+                    t = types.PointerTo(t);
+                } else {
+                    t = types.ArrayOf(t, dim);
+                }
+            }
+        }
+        return t;
+    }
+
+    /**
+     * @brief get the type of a function
+     * 
+     * @param fn the FuncDefAST
+     * @return const Type* - a FuncType
+     */
+    const Type* typeOf(FuncDefAST* fn) {
+        vector<const Type*> params;
+        for (auto& _param : *fn->paramList) {
+            auto param = reinterpret_cast<ParamAST*>(_param.get());
+            params.push_back(typeOf(param->t.get()));
+        }
+        return types.Func(typeOf(fn->retType.get()), params);
+    }
+
+    /**
+     * @brief reduce dimension of array type
+     * 
+     * @param t the type
+     * @return const Type* - the reduced type
+     * 
+     * @note change "[5 x [4 x i64]]" to "[4 x i64]"
+     * @note change "i64**" to "i64*"
+     */
+    const Type* reduceDim(const Type* t) { return t->elem(); }
+
     /**
      * @brief reduce dimension of array type for dim times
      * 
-     * @param t the type string
+     * @param t the type
      * @param dim the number of times to reduce
-     * @return string - the reduced type string
+     * @return const Type* - the reduced type
      */
-    string reduceDim(string t, int dim) {
+    const Type* reduceDim(const Type* t, int dim) {
         for (int i = 0; i < dim; i++) {
-            t = reduceDim(t);
+            t = t->elem();
         }
         return t;
     }
@@ -1120,34 +1715,34 @@ class Compiler {
      * @note support only pointer now (not like [5 x [4 x i64]])
      * 
      * @param t 
-     * @return string 
+     * @return const Type* 
      */
-    string increaseDim(string t) { return t + "*"; }
+    const Type* increaseDim(const Type* t) { return types.PointerTo(t); }
 
     /**
      * @brief whether a type is a pointer type
      * 
-     * @param t the type string
+     * @param t the type
      * @return true 
      * @return false 
      */
-    bool isPtr(string t) { return t.find("*") != string::npos || t == "nil"; }
+    bool isPtr(const Type* t) { return t->isPtr(); }
 
     /**
      * @brief try to fit tRight to tLeft, if cannot, return false
      * @note tRight maybe change to tLeft if it is nil
      * 
-     * @param tLeft the type string of LHS
-     * @param tRight the type string of RHS
+     * @param tLeft the type of LHS
+     * @param tRight the type of RHS
      * @return true 
      * @return false 
      */
-    bool typeMatch(string tLeft, string& tRight) {
+    bool typeMatch(const Type* tLeft, const Type*& tRight) {
         // TODO use this in all type checking system
         if (tLeft == tRight) return true;
         // right side is nil, left is X*
         // convert nil to X*, and return true
-        if (tRight == "nil" && isPtr(tLeft)) {
+        if (tRight->isNil() && isPtr(tLeft)) {
             tRight = tLeft;
             return true;
         }
@@ -1156,21 +1751,35 @@ class Compiler {
 
     /**
      * @brief infer the type of an expression
+     * @note the result is cached in the ExpAST, so each node is inferred once
      * 
      * @param _expr the expression AST
-     * @return string 
+     * @return const Type* 
      */
-    string inferType(const pAST& _expr) {
+    const Type* inferType(const pAST& _expr) {
         auto expr = reinterpret_cast<ExpAST*>(_expr.get());
+        if (expr->inferred == nullptr) {
+            expr->inferred = inferTypeUncached(expr);
+        }
+        return expr->inferred;
+    }
+
+    /**
+     * @brief infer the type of an expression, whose children may be cached
+     * 
+     * @param expr the expression AST
+     * @return const Type* 
+     */
+    const Type* inferTypeUncached(ExpAST* expr) {
         if (expr->type() == TType::NumberT) {
-            return "i64";
+            return types.Int();
         } else if (expr->type() == TType::BinExpT) {
             auto exp = reinterpret_cast<BinExpAST*>(expr);
             auto left = inferType(exp->left);
             auto right = inferType(exp->right);
             if (left != right) {
                 cerr << "inferType: type mismatch" << endl;
-                assert(false);
+                throw CompileError();
             }
             return left;
         } else if (expr->type() == TType::UnaryExpT) {
@@ -1181,42 +1790,39 @@ class Compiler {
             return inferType(exp->p);
         } else if (expr->type() == TType::CallExpT) {
             auto exp = reinterpret_cast<CallExpAST*>(expr);
-            auto obj = scope->Lookup(exp->funcName).second;
+            auto obj = scope->Lookup(exp->sym);
             if (obj != nullptr) {
-                auto funcDefAST = reinterpret_cast<FuncDefAST*>(obj->Node);
-                return funcDefAST->getRetType();
+                return reinterpret_cast<const FuncType*>(obj->Ty)->ret;
             } else {
                 cerr << "inferType: function " << exp->funcName << " undefined"
                      << endl;
-                assert(false);
-                return "";
+                throw CompileError();
             }
         } else if (expr->type() == TType::LValT) {
             auto exp = reinterpret_cast<LValAST*>(expr);
-            auto obj = scope->Lookup(exp->ident).second;
+            auto obj = scope->Lookup(exp->sym);
             if (obj == nullptr) {
                 cerr << "inferType: variable " << exp->ident << " undefined"
                      << endl;
-                assert(false);
+                throw CompileError();
             }
-            auto baseType = obj->Node->info();
+            auto baseType = obj->Ty;
             if (exp->indexList == nullptr) {
                 cerr << "inferType: indexList is null" << endl;
-                assert(false);
+                throw CompileError();
             }
             return reduceDim(baseType, exp->indexList->size());
         } else if (expr->type() == TType::MakeExpT) {
-            return expr->info();
+            return typeOf(reinterpret_cast<MakeExpAST*>(expr)->t.get());
         } else if (expr->type() == TType::ArrayExpT) {
             // always specified in code, like []int{1, 2, 3}
-            return expr->info();
+            return typeOf(reinterpret_cast<ArrayExpAST*>(expr)->t.get());
         } else if (expr->type() == TType::NilT) {
-            return expr->info();
+            return types.Nil();
         } else {
             cerr << "inferType: unknown type of ExpAST" << endl;
-            assert(false);
-            return "";
+            throw CompileError();
         }
-        return "";
+        return nullptr;
     }
 };
\ No newline at end of file
@@ -0,0 +1,333 @@
+#pragma once
+
+/**
+ * @file Emitter.hpp
+ * @author Asilvorcarp (asilvorcarp@qq.com)
+ * @brief emit LLVM bitcode or object files in process with the LLVM C++ API
+ * @version 2.0
+ * @date 2023-06-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * @note only built with -DMINIGO_LLVM, see `make llvm`
+ */
+
+#include <IRWriter.hpp>
+
+#include <cassert>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <streambuf>
+#include <string>
+
+using namespace std;
+
+/**
+ * @brief the kinds of output files
+ */
+enum class EmitKind {
+    // textual LLVM IR, .ll
+    IRE,
+    // LLVM bitcode, .bc
+    BitcodeE,
+    // native object file, .o
+    ObjectE,
+};
+
+/**
+ * @brief get the kind of the output file from its extension
+ *
+ * @param path the output file
+ * @return EmitKind - IRE if unknown
+ */
+inline EmitKind emitKindOf(const string& path) {
+    auto endsWith = [&](const string& ext) {
+        return path.size() >= ext.size() &&
+               path.compare(path.size() - ext.size(), ext.size(), ext) == 0;
+    };
+    if (endsWith(".bc")) {
+        return EmitKind::BitcodeE;
+    } else if (endsWith(".o")) {
+        return EmitKind::ObjectE;
+    }
+    return EmitKind::IRE;
+}
+
+#ifdef MINIGO_LLVM
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+#include <llvm/Transforms/IPO/Internalize.h>
+
+// runtime_bc and runtime_bc_len, src/runtime.c as bitcode made by `make llvm`
+#include <runtime.bc.hpp>
+
+/**
+ * @brief a streambuf writing to an llvm::raw_ostream, so that the compiler,
+ * which writes to an ostream, streams the IR into LLVM's buffers
+ */
+class RawOstreamBuf : public streambuf {
+    llvm::raw_ostream& os;
+
+   protected:
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            os << traits_type::to_char_type(c);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    streamsize xsputn(const char* s, streamsize n) override {
+        os.write(s, n);
+        return n;
+    }
+
+   public:
+    /**
+     * @brief Construct a new RawOstreamBuf object
+     *
+     * @param os the raw_ostream, which outlives this
+     */
+    RawOstreamBuf(llvm::raw_ostream& os) : os(os) {}
+};
+
+/**
+ * @brief turn the LLVM IR of the compiler into a module, optimize it and
+ * write it as bitcode or an object file, without clang
+ * @note the IR is parsed in process from the one buffer it is streamed
+ * into, so no .ll file or process is involved
+ */
+class ModuleEmitter {
+    // a unique_ptr since the JIT takes it with the module, see Run()
+    unique_ptr<llvm::LLVMContext> ctx = make_unique<llvm::LLVMContext>();
+    unique_ptr<llvm::Module> mod;
+    unique_ptr<llvm::TargetMachine> tm;
+
+   public:
+    /**
+     * @brief the ms spent parsing and verifying the textual IR, measured
+     * so that its share of the build is known, see Readme.md
+     */
+    double parseMs = 0;
+
+   private:
+    void initTarget() {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+        auto triple = mod->getTargetTriple();
+        if (triple.empty()) {
+            triple = llvm::sys::getDefaultTargetTriple();
+            mod->setTargetTriple(triple);
+        }
+        string err;
+        auto target = llvm::TargetRegistry::lookupTarget(triple, err);
+        if (target == nullptr) {
+            cerr << "ModuleEmitter: " << err << endl;
+            throw CompileError();
+        }
+        tm.reset(target->createTargetMachine(triple, "generic", "",
+                                             llvm::TargetOptions(),
+                                             llvm::Reloc::PIC_));
+        mod->setDataLayout(tm->createDataLayout());
+    }
+
+   public:
+    /**
+     * @brief Construct a new ModuleEmitter object
+     *
+     * @param write writes the textual LLVM IR of the whole file to the
+     * ostream, like Compiler::Compile(unit, os)
+     */
+    ModuleEmitter(const function<void(ostream&)>& write) {
+        // the IR is written straight into the buffer LLVM parses, with no
+        // other copy of it, and a '\0' after it as MemoryBuffer requires
+        llvm::SmallString<0> ir;
+        {
+            llvm::raw_svector_ostream raw(ir);
+            RawOstreamBuf buf(raw);
+            ostream os(&buf);
+            write(os);
+        }
+        ir.push_back('\0');
+        auto start = chrono::steady_clock::now();
+        llvm::SMDiagnostic diag;
+        mod = llvm::parseAssembly(
+            llvm::MemoryBufferRef(llvm::StringRef(ir.data(), ir.size() - 1),
+                                  "miniGo"),
+            diag, *ctx);
+        if (mod == nullptr) {
+            diag.print("miniGo", llvm::errs());
+            throw CompileError();
+        }
+        if (llvm::verifyModule(*mod, &llvm::errs())) {
+            cerr << "ModuleEmitter: invalid module" << endl;
+            throw CompileError();
+        }
+        parseMs = chrono::duration<double, milli>(
+                      chrono::steady_clock::now() - start)
+                      .count();
+        initTarget();
+    }
+
+    /**
+     * @brief link the runtime into the module before Optimize(), so that
+     * the fast paths of getchar, putchar and the arena can be inlined
+     * @note the runtime functions become internal, so the output does not
+     * need build/runtime.o
+     */
+    void LinkRuntime() {
+        llvm::StringRef bc(reinterpret_cast<const char*>(runtime_bc),
+                           runtime_bc_len);
+        auto rt = llvm::parseBitcodeFile(
+            llvm::MemoryBufferRef(bc, "runtime.bc"), *ctx);
+        if (!rt) {
+            cerr << "ModuleEmitter: invalid runtime - "
+                 << llvm::toString(rt.takeError()) << endl;
+            throw CompileError();
+        }
+        (*rt)->setTargetTriple(mod->getTargetTriple());
+        (*rt)->setDataLayout(mod->getDataLayout());
+        // only what came from the runtime is internalized
+        auto internalize = [](llvm::Module& m,
+                              const llvm::StringSet<>& fromRuntime) {
+            llvm::internalizeModule(m, [&](const llvm::GlobalValue& gv) {
+                return fromRuntime.count(gv.getName()) == 0;
+            });
+        };
+        if (llvm::Linker::linkModules(*mod, std::move(*rt),
+                                      llvm::Linker::Flags::None,
+                                      internalize)) {
+            cerr << "ModuleEmitter: cannot link the runtime" << endl;
+            throw CompileError();
+        }
+    }
+
+    /**
+     * @brief run the optimization pipeline of clang -O<level>
+     *
+     * @param level 0 to 3
+     */
+    void Optimize(int level) {
+        llvm::LoopAnalysisManager lam;
+        llvm::FunctionAnalysisManager fam;
+        llvm::CGSCCAnalysisManager cgam;
+        llvm::ModuleAnalysisManager mam;
+        llvm::PassBuilder pb(tm.get());
+        pb.registerModuleAnalyses(mam);
+        pb.registerCGSCCAnalyses(cgam);
+        pb.registerFunctionAnalyses(fam);
+        pb.registerLoopAnalyses(lam);
+        pb.crossRegisterProxies(lam, fam, cgam, mam);
+        llvm::OptimizationLevel levels[] = {
+            llvm::OptimizationLevel::O0, llvm::OptimizationLevel::O1,
+            llvm::OptimizationLevel::O2, llvm::OptimizationLevel::O3};
+        auto opt = levels[max(0, min(level, 3))];
+        auto mpm = level == 0 ? pb.buildO0DefaultPipeline(opt)
+                              : pb.buildPerModuleDefaultPipeline(opt);
+        mpm.run(*mod, mam);
+    }
+
+    /**
+     * @brief run @main of the module with the ORC JIT, reading stdin and
+     * writing stdout of this process
+     * @note the module is moved into the JIT, so nothing can be done with
+     * this emitter after this
+     *
+     * @return int - the return value of @main
+     */
+    int Run() {
+        auto check = [](llvm::Error err) {
+            if (err) {
+                cerr << "ModuleEmitter: " << llvm::toString(std::move(err))
+                     << endl;
+                throw CompileError();
+            }
+        };
+        auto jit = llvm::orc::LLJITBuilder().create();
+        check(jit.takeError());
+        // libc, like malloc and write, is from this process
+        auto& lib = (*jit)->getMainJITDylib();
+        auto process =
+            llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+                (*jit)->getDataLayout().getGlobalPrefix());
+        check(process.takeError());
+        lib.addGenerator(std::move(*process));
+        check((*jit)->addIRModule(
+            llvm::orc::ThreadSafeModule(std::move(mod), std::move(ctx))));
+        auto mainSym = (*jit)->lookup("main");
+        check(mainSym.takeError());
+        auto mainFn =
+            reinterpret_cast<int64_t (*)()>(mainSym->getAddress());
+        return mainFn();
+    }
+
+    /**
+     * @brief write the module to the file
+     * @note it is written to a temp file, renamed over the file only if all
+     * was written, so no partial output is left, even for the cache to copy
+     *
+     * @param path the output file
+     * @param kind BitcodeE or ObjectE
+     */
+    void Write(const string& path, EmitKind kind) {
+        auto tmp = TempPath(path);
+        {
+            error_code ec;
+            llvm::raw_fd_ostream out(tmp, ec, llvm::sys::fs::OF_None);
+            if (ec) {
+                cerr << "ModuleEmitter: cannot open " << tmp << " - "
+                     << ec.message() << endl;
+                throw CompileError();
+            }
+            if (kind == EmitKind::BitcodeE) {
+                llvm::WriteBitcodeToFile(*mod, out);
+            } else if (kind == EmitKind::ObjectE) {
+                llvm::legacy::PassManager pm;
+                if (tm->addPassesToEmitFile(pm, out, nullptr,
+                                            llvm::CGFT_ObjectFile)) {
+                    llvm::sys::fs::remove(tmp);
+                    cerr << "ModuleEmitter: cannot emit object files" << endl;
+                    throw CompileError();
+                }
+                pm.run(*mod);
+            } else {
+                mod->print(out, nullptr);
+            }
+            out.close();
+            if (out.has_error()) {
+                cerr << "ModuleEmitter: cannot write " << path << " - "
+                     << out.error().message() << endl;
+                out.clear_error();
+                llvm::sys::fs::remove(tmp);
+                throw CompileError();
+            }
+        }
+        if (auto ec = llvm::sys::fs::rename(tmp, path)) {
+            cerr << "ModuleEmitter: cannot rename " << tmp << " - "
+                 << ec.message() << endl;
+            llvm::sys::fs::remove(tmp);
+            throw CompileError();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+/**
+ * @file Error.hpp
+ * @author Asilvorcarp (asilvorcarp@qq.com)
+ * @brief the error thrown when a file cannot be compiled
+ * @version 2.0
+ * @date 2023-06-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <exception>
+
+using namespace std;
+
+/**
+ * @brief thrown after the error of the file being compiled is printed to
+ * cerr, so that build() fails the file with a status instead of aborting,
+ * and the other files of the batch mode go on
+ */
+class CompileError : public exception {
+   public:
+    const char* what() const noexcept override { return "compile error"; }
+};
@@ -0,0 +1,371 @@
+#pragma once
+
+/**
+ * @file Escape.hpp
+ * @author Asilvorcarp (asilvorcarp@qq.com)
+ * @brief find the arrays that never escape the function creating them
+ * @version 2.0
+ * @date 2023-06-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <AST.hpp>
+
+using namespace std;
+
+/**
+ * @brief mark the make() and array literals whose arrays never escape the
+ * function, so that they can be allocated on the stack
+ * @note an array escapes if it is returned, stored into another array or a
+ * global, copied to another var, or passed to a param that escapes
+ * @note whether each param escapes is a summary of the function, computed
+ * until nothing changes, so that recursive calls are fine
+ */
+class EscapeAnalysis {
+    /**
+     * @brief a local var (or param) which may hold arrays
+     */
+    struct Var {
+        bool escapes = false;
+        /**
+         * @brief the innermost loop the var is declared in
+         */
+        ForStmtAST* loop;
+        /**
+         * @brief the arrays assigned to the var, (site, innermost loop)
+         */
+        vector<pair<ExpAST*, ForStmtAST*>> sites;
+    };
+
+    /**
+     * @brief func name -> whether each param escapes
+     */
+    unordered_map<Symbol, vector<bool>> paramEscapes;
+    /**
+     * @brief the vars of the function being analyzed
+     */
+    vector<unique_ptr<Var>> vars;
+    vector<unordered_map<Symbol, Var*>> scopes;
+    vector<ForStmtAST*> loops;
+
+    ForStmtAST* currentLoop() {
+        return loops.empty() ? nullptr : loops.back();
+    }
+
+    Var* declare(Symbol sym) {
+        vars.push_back(make_unique<Var>());
+        vars.back()->loop = currentLoop();
+        scopes.back()[sym] = vars.back().get();
+        return vars.back().get();
+    }
+
+    /**
+     * @brief find the local var, nullptr for globals
+     */
+    Var* lookup(Symbol sym) {
+        for (int i = scopes.size() - 1; i >= 0; i--) {
+            auto it = scopes[i].find(sym);
+            if (it != scopes[i].end()) {
+                return it->second;
+            }
+        }
+        return nullptr;
+    }
+
+    static bool isSite(BaseAST* exp) {
+        return exp->type() == TType::MakeExpT ||
+               exp->type() == TType::ArrayExpT;
+    }
+
+    static BaseAST* stripParen(BaseAST* exp) {
+        while (exp->type() == TType::ParenExpT) {
+            exp = reinterpret_cast<ParenExpAST*>(exp)->p.get();
+        }
+        return exp;
+    }
+
+    /**
+     * @brief visit the operands of a make() or array literal
+     */
+    void visitSite(BaseAST* exp) {
+        if (exp->type() == TType::MakeExpT) {
+            use(reinterpret_cast<MakeExpAST*>(exp)->len.get());
+        } else {
+            for (auto& initVal : *reinterpret_cast<ArrayExpAST*>(exp)->initValList) {
+                escape(initVal.get());
+            }
+        }
+    }
+
+    void visitCall(CallExpAST* exp) {
+        auto it = paramEscapes.find(exp->sym);
+        if (it == paramEscapes.end() &&
+            (exp->funcName == "len" || exp->funcName == "cap")) {
+            // builtins only read the header
+            for (auto& arg : *exp->argList) {
+                use(arg.get());
+            }
+            return;
+        }
+        for (int i = 0; i < exp->argList->size(); i++) {
+            auto arg = exp->argList->at(i).get();
+            if (it == paramEscapes.end() || i >= it->second.size() ||
+                it->second[i]) {
+                escape(arg);
+            } else {
+                // lives until the call returns
+                use(arg);
+            }
+        }
+    }
+
+    /**
+     * @brief visit an expression whose value is only read, like an operand
+     * of == or an index
+     */
+    void use(BaseAST* exp) {
+        switch (exp->type()) {
+            case TType::LValT:
+                for (auto& idx : *reinterpret_cast<LValAST*>(exp)->indexList) {
+                    use(idx.get());
+                }
+                break;
+            case TType::BinExpT:
+                use(reinterpret_cast<BinExpAST*>(exp)->left.get());
+                use(reinterpret_cast<BinExpAST*>(exp)->right.get());
+                break;
+            case TType::UnaryExpT:
+                use(reinterpret_cast<UnaryExpAST*>(exp)->p.get());
+                break;
+            case TType::ParenExpT:
+                use(reinterpret_cast<ParenExpAST*>(exp)->p.get());
+                break;
+            case TType::CallExpT:
+                visitCall(reinterpret_cast<CallExpAST*>(exp));
+                break;
+            case TType::MakeExpT:
+            case TType::ArrayExpT:
+                visitSite(exp);
+                break;
+            default:
+                break;
+        }
+    }
+
+    /**
+     * @brief visit an expression whose value goes somewhere unknown
+     */
+    void escape(BaseAST* exp) {
+        exp = stripParen(exp);
+        if (exp->type() == TType::LValT &&
+            reinterpret_cast<LValAST*>(exp)->indexList->empty()) {
+            auto var = lookup(reinterpret_cast<LValAST*>(exp)->sym);
+            if (var != nullptr) {
+                var->escapes = true;
+            }
+            return;
+        }
+        use(exp);
+    }
+
+    /**
+     * @brief visit the value assigned to a var, nullptr for globals
+     */
+    void assign(Var* var, BaseAST* exp) {
+        exp = stripParen(exp);
+        if (var != nullptr && isSite(exp)) {
+            var->sites.push_back({reinterpret_cast<ExpAST*>(exp), currentLoop()});
+            visitSite(exp);
+        } else {
+            escape(exp);
+        }
+    }
+
+    void visitStmt(BaseAST* stmt) {
+        switch (stmt->type()) {
+            case TType::VarSpecT: {
+                auto stm = reinterpret_cast<VarSpecAST*>(stmt);
+                for (int i = 0; i < stm->syms.size(); i++) {
+                    auto var = declare(stm->syms[i]);
+                    if (!stm->initVals->empty()) {
+                        assign(var, stm->initVals->at(i).get());
+                    }
+                }
+                break;
+            }
+            case TType::ShortVarDeclT: {
+                auto stm = reinterpret_cast<ShortVarDeclAST*>(stmt);
+                auto& targets = *stm->targets;
+                // the new vars are visible after the values
+                vector<Var*> targetVars(targets.size());
+                vector<bool> isNew(targets.size());
+                for (int i = 0; i < targets.size(); i++) {
+                    auto tar = reinterpret_cast<LValAST*>(targets[i].get());
+                    if (!tar->indexList->empty()) {
+                        // stored into an array
+                        use(tar);
+                    } else if (stm->isDefine &&
+                               !scopes.back().count(tar->sym)) {
+                        vars.push_back(make_unique<Var>());
+                        vars.back()->loop = currentLoop();
+                        targetVars[i] = vars.back().get();
+                        isNew[i] = true;
+                    } else {
+                        targetVars[i] = lookup(tar->sym);
+                    }
+                }
+                for (int i = 0; i < targets.size(); i++) {
+                    assign(targetVars[i], stm->initVals->at(i).get());
+                }
+                for (int i = 0; i < targets.size(); i++) {
+                    if (isNew[i]) {
+                        auto tar = reinterpret_cast<LValAST*>(targets[i].get());
+                        scopes.back()[tar->sym] = targetVars[i];
+                    }
+                }
+                break;
+            }
+            case TType::IfStmtT: {
+                auto stm = reinterpret_cast<IfStmtAST*>(stmt);
+                scopes.emplace_back();
+                if (stm->init != nullptr) {
+                    visitStmt(stm->init.get());
+                }
+                use(stm->cond.get());
+                visitStmt(stm->body.get());
+                if (stm->elseBlockStmt != nullptr) {
+                    visitStmt(stm->elseBlockStmt.get());
+                }
+                scopes.pop_back();
+                break;
+            }
+            case TType::ForStmtT: {
+                auto stm = reinterpret_cast<ForStmtAST*>(stmt);
+                scopes.emplace_back();
+                visitStmt(stm->init.get());
+                loops.push_back(stm);
+                use(stm->cond.get());
+                visitStmt(stm->body.get());
+                visitStmt(stm->post.get());
+                loops.pop_back();
+                scopes.pop_back();
+                break;
+            }
+            case TType::BlockT:
+                scopes.emplace_back();
+                for (auto& s : *reinterpret_cast<BlockAST*>(stmt)->stmts) {
+                    visitStmt(s.get());
+                }
+                scopes.pop_back();
+                break;
+            case TType::ReturnStmtT: {
+                auto stm = reinterpret_cast<ReturnStmtAST*>(stmt);
+                if (stm->exp != nullptr) {
+                    escape(stm->exp.get());
+                }
+                break;
+            }
+            case TType::ExpStmtT:
+                use(reinterpret_cast<ExpStmtAST*>(stmt)->exp.get());
+                break;
+            case TType::IncDecStmtT:
+                use(reinterpret_cast<IncDecStmtAST*>(stmt)->target.get());
+                break;
+            default:
+                break;
+        }
+    }
+
+    /**
+     * @brief analyze a function with the current summaries
+     *
+     * @param fn the function with body
+     * @return vector<bool> - whether each param escapes
+     */
+    vector<bool> analyze(FuncDefAST* fn) {
+        vars.clear();
+        scopes.assign(1, {});
+        loops.clear();
+        vector<Var*> params;
+        for (auto& _param : *fn->paramList) {
+            params.push_back(declare(reinterpret_cast<ParamAST*>(_param.get())->sym));
+        }
+        // params and the top level of the body share the scope
+        for (auto& stmt : *reinterpret_cast<BlockAST*>(fn->body.get())->stmts) {
+            visitStmt(stmt.get());
+        }
+        vector<bool> ret;
+        for (auto param : params) {
+            ret.push_back(param->escapes);
+        }
+        return ret;
+    }
+
+    /**
+     * @brief set onStack of the arrays of the function analyzed last
+     */
+    void mark() {
+        for (auto& var : vars) {
+            if (var->escapes) {
+                continue;
+            }
+            for (auto& [site, loop] : var->sites) {
+                // in a loop, only a var of this iteration may hold the array,
+                // so that the stack slot can be reused
+                if (loop == var->loop) {
+                    setOnStack(site);
+                }
+            }
+        }
+    }
+
+    static void setOnStack(ExpAST* site) {
+        if (site->type() == TType::MakeExpT) {
+            reinterpret_cast<MakeExpAST*>(site)->onStack = true;
+        } else {
+            reinterpret_cast<ArrayExpAST*>(site)->onStack = true;
+        }
+    }
+
+   public:
+    /**
+     * @brief analyze all functions of the file, and mark the arrays
+     *
+     * @param file the CompUnitAST (file)
+     */
+    void Run(CompUnitAST* file) {
+        // optimistic at first, only grows
+        for (auto& fn : file->Funcs) {
+            if (fn->body != nullptr) {
+                paramEscapes[fn->sym] = vector<bool>(fn->paramList->size(), false);
+            }
+        }
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (auto& fn : file->Funcs) {
+                if (fn->body == nullptr) {
+                    continue;
+                }
+                auto summary = analyze(fn.get());
+                if (summary != paramEscapes[fn->sym]) {
+                    paramEscapes[fn->sym] = summary;
+                    changed = true;
+                }
+            }
+        }
+        for (auto& fn : file->Funcs) {
+            if (fn->body != nullptr) {
+                analyze(fn.get());
+                mark();
+            }
+        }
+    }
+};
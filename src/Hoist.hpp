@@ -0,0 +1,414 @@
+#pragma once
+
+/**
+ * @file Hoist.hpp
+ * @author Asilvorcarp (asilvorcarp@qq.com)
+ * @brief find the row ptrs which can be loaded once before a loop
+ * @version 2.0
+ * @date 2023-06-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <AST.hpp>
+#include <Scope.hpp>
+#include <Type.hpp>
+
+using namespace std;
+
+/**
+ * @brief the rows like a[i] in a[i][j] which are the same in every iteration
+ * of a loop, so that they can be loaded before the loop
+ * @note a row is invariant if the var and the indices are not assigned in the
+ * loop, no row of the same type is stored in the loop, and the loop calls no
+ * function (which may store anything)
+ * @note a row is hoisted only if the first iteration surely loads it, i.e. it
+ * is in the cond or the leading simple statements of the body, so that the
+ * load before the loop never reads what the loop would not
+ */
+class LoopInvariants {
+    Scope* scope;
+    /**
+     * @brief the idents assigned or declared in the loop
+     */
+    unordered_set<Symbol> assigned;
+    unordered_set<Symbol> declared;
+    /**
+     * @brief the stores into arrays, (ident, number of indices)
+     */
+    vector<pair<Symbol, int>> stores;
+    bool hasCall = false;
+    /**
+     * @brief the invariant rows, (key, (lval, number of indices))
+     */
+    vector<pair<string, pair<LValAST*, int>>> rows;
+
+    void scanExp(BaseAST* exp) {
+        if (exp == nullptr) {
+            return;
+        }
+        switch (exp->type()) {
+            case TType::LValT:
+                for (auto& idx : *reinterpret_cast<LValAST*>(exp)->indexList) {
+                    scanExp(idx.get());
+                }
+                break;
+            case TType::BinExpT:
+                scanExp(reinterpret_cast<BinExpAST*>(exp)->left.get());
+                scanExp(reinterpret_cast<BinExpAST*>(exp)->right.get());
+                break;
+            case TType::UnaryExpT:
+                scanExp(reinterpret_cast<UnaryExpAST*>(exp)->p.get());
+                break;
+            case TType::ParenExpT:
+                scanExp(reinterpret_cast<ParenExpAST*>(exp)->p.get());
+                break;
+            case TType::CallExpT: {
+                auto call = reinterpret_cast<CallExpAST*>(exp);
+                auto obj = scope->Lookup(call->sym);
+                if (obj == nullptr ||
+                    obj->Node->type() != TType::BuiltinFuncT) {
+                    hasCall = true;
+                }
+                for (auto& arg : *call->argList) {
+                    scanExp(arg.get());
+                }
+                break;
+            }
+            case TType::MakeExpT:
+                scanExp(reinterpret_cast<MakeExpAST*>(exp)->len.get());
+                break;
+            case TType::ArrayExpT:
+                for (auto& v : *reinterpret_cast<ArrayExpAST*>(exp)->initValList) {
+                    scanExp(v.get());
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    void scanStmt(BaseAST* stmt) {
+        if (stmt == nullptr) {
+            return;
+        }
+        switch (stmt->type()) {
+            case TType::VarSpecT: {
+                auto stm = reinterpret_cast<VarSpecAST*>(stmt);
+                for (auto sym : stm->syms) {
+                    assigned.insert(sym);
+                    declared.insert(sym);
+                }
+                for (auto& v : *stm->initVals) {
+                    scanExp(v.get());
+                }
+                break;
+            }
+            case TType::ShortVarDeclT: {
+                auto stm = reinterpret_cast<ShortVarDeclAST*>(stmt);
+                for (auto& _tar : *stm->targets) {
+                    auto tar = reinterpret_cast<LValAST*>(_tar.get());
+                    if (!tar->indexList->empty()) {
+                        stores.push_back({tar->sym, tar->indexList->size()});
+                        scanExp(tar);
+                    } else {
+                        assigned.insert(tar->sym);
+                        if (stm->isDefine) {
+                            declared.insert(tar->sym);
+                        }
+                    }
+                }
+                for (auto& v : *stm->initVals) {
+                    scanExp(v.get());
+                }
+                break;
+            }
+            case TType::IncDecStmtT:
+                assigned.insert(
+                    reinterpret_cast<LValAST*>(
+                        reinterpret_cast<IncDecStmtAST*>(stmt)->target.get())
+                        ->sym);
+                break;
+            case TType::IfStmtT: {
+                auto stm = reinterpret_cast<IfStmtAST*>(stmt);
+                if (stm->init != nullptr) {
+                    scanStmt(stm->init.get());
+                }
+                scanExp(stm->cond.get());
+                scanStmt(stm->body.get());
+                if (stm->elseBlockStmt != nullptr) {
+                    scanStmt(stm->elseBlockStmt.get());
+                }
+                break;
+            }
+            case TType::ForStmtT: {
+                auto stm = reinterpret_cast<ForStmtAST*>(stmt);
+                scanStmt(stm->init.get());
+                scanExp(stm->cond.get());
+                scanStmt(stm->body.get());
+                scanStmt(stm->post.get());
+                break;
+            }
+            case TType::BlockT:
+                for (auto& s : *reinterpret_cast<BlockAST*>(stmt)->stmts) {
+                    scanStmt(s.get());
+                }
+                break;
+            case TType::ExpStmtT:
+                scanExp(reinterpret_cast<ExpStmtAST*>(stmt)->exp.get());
+                break;
+            case TType::ReturnStmtT: {
+                auto stm = reinterpret_cast<ReturnStmtAST*>(stmt);
+                if (stm->exp != nullptr) {
+                    scanExp(stm->exp.get());
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    /**
+     * @brief whether the value of the index is the same in every iteration
+     */
+    bool isInvariant(BaseAST* exp) {
+        switch (exp->type()) {
+            case TType::NumberT:
+                return true;
+            case TType::LValT: {
+                auto lval = reinterpret_cast<LValAST*>(exp);
+                return lval->indexList->empty() && !assigned.count(lval->sym);
+            }
+            case TType::BinExpT: {
+                auto bin = reinterpret_cast<BinExpAST*>(exp);
+                return isInvariant(bin->left.get()) &&
+                       isInvariant(bin->right.get());
+            }
+            case TType::UnaryExpT:
+                return isInvariant(reinterpret_cast<UnaryExpAST*>(exp)->p.get());
+            case TType::ParenExpT:
+                return isInvariant(reinterpret_cast<ParenExpAST*>(exp)->p.get());
+            default:
+                return false;
+        }
+    }
+
+    /**
+     * @brief collect the rows loaded whenever the expression is evaluated
+     */
+    void collect(BaseAST* exp, const unordered_set<const Type*>& storedTypes) {
+        if (exp == nullptr) {
+            return;
+        }
+        switch (exp->type()) {
+            case TType::LValT: {
+                auto lval = reinterpret_cast<LValAST*>(exp);
+                for (auto& idx : *lval->indexList) {
+                    collect(idx.get(), storedTypes);
+                }
+                // a[i] itself is a row if it is read as an array
+                addRow(lval, lval->indexList->size(), storedTypes);
+                break;
+            }
+            case TType::BinExpT: {
+                auto bin = reinterpret_cast<BinExpAST*>(exp);
+                collect(bin->left.get(), storedTypes);
+                // the right operand of && and || may be skipped
+                if (bin->op != BinExpAST::Op::AND &&
+                    bin->op != BinExpAST::Op::OR) {
+                    collect(bin->right.get(), storedTypes);
+                }
+                break;
+            }
+            case TType::UnaryExpT:
+                collect(reinterpret_cast<UnaryExpAST*>(exp)->p.get(), storedTypes);
+                break;
+            case TType::ParenExpT:
+                collect(reinterpret_cast<ParenExpAST*>(exp)->p.get(), storedTypes);
+                break;
+            case TType::CallExpT:
+                for (auto& arg : *reinterpret_cast<CallExpAST*>(exp)->argList) {
+                    collect(arg.get(), storedTypes);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    /**
+     * @brief add the longest invariant row of the first n indices of lval
+     */
+    void addRow(LValAST* lval, int n,
+                const unordered_set<const Type*>& storedTypes) {
+        if (n <= 0 || assigned.count(lval->sym)) {
+            return;
+        }
+        auto obj = scope->Lookup(lval->sym);
+        if (obj == nullptr || !obj->Ty->isPtr()) {
+            return;
+        }
+        auto ty = obj->Ty;
+        int k = 0;
+        while (k < n && isInvariant(lval->indexList->at(k).get())) {
+            ty = ty->elem();
+            if (!ty->isPtr() || storedTypes.count(ty)) {
+                break;
+            }
+            k++;
+        }
+        if (k == 0) {
+            return;
+        }
+        auto key = Key(scope, lval, k);
+        for (auto& row : rows) {
+            if (row.first == key) {
+                return;
+            }
+        }
+        rows.push_back({key, {lval, k}});
+    }
+
+   public:
+    /**
+     * @brief analyze the loop, whose init is compiled and in the scope
+     *
+     * @param scope the scope of the loop
+     * @param loop the ForStmtAST
+     */
+    LoopInvariants(Scope* scope, ForStmtAST* loop) : scope(scope) {
+        scanExp(loop->cond.get());
+        scanStmt(loop->body.get());
+        scanStmt(loop->post.get());
+        if (hasCall) {
+            return;
+        }
+        // the types of the rows which may be changed in the loop
+        unordered_set<const Type*> storedTypes;
+        for (auto& [sym, n] : stores) {
+            auto obj = scope->Lookup(sym);
+            if (declared.count(sym) || obj == nullptr) {
+                // the type is unknown before the loop is compiled
+                return;
+            }
+            auto ty = obj->Ty;
+            for (int i = 0; i < n && !ty->isInt(); i++) {
+                ty = ty->elem();
+            }
+            storedTypes.insert(ty);
+        }
+        collect(loop->cond.get(), storedTypes);
+        for (auto& _stmt : *reinterpret_cast<BlockAST*>(loop->body.get())->stmts) {
+            auto stmt = _stmt.get();
+            if (stmt->type() == TType::ShortVarDeclT) {
+                auto stm = reinterpret_cast<ShortVarDeclAST*>(stmt);
+                for (auto& v : *stm->initVals) {
+                    collect(v.get(), storedTypes);
+                }
+                for (auto& _tar : *stm->targets) {
+                    auto tar = reinterpret_cast<LValAST*>(_tar.get());
+                    for (auto& idx : *tar->indexList) {
+                        collect(idx.get(), storedTypes);
+                    }
+                    addRow(tar, tar->indexList->size() - 1, storedTypes);
+                }
+            } else if (stmt->type() == TType::VarSpecT) {
+                for (auto& v : *reinterpret_cast<VarSpecAST*>(stmt)->initVals) {
+                    collect(v.get(), storedTypes);
+                }
+            } else if (stmt->type() == TType::ExpStmtT) {
+                collect(reinterpret_cast<ExpStmtAST*>(stmt)->exp.get(),
+                        storedTypes);
+            } else if (stmt->type() != TType::IncDecStmtT) {
+                // may break or return before the rows after it
+                break;
+            }
+        }
+    }
+
+    /**
+     * @brief get the invariant rows
+     *
+     * @return (key, (lval, number of indices)) - the row is the first
+     * indices of the lval
+     */
+    const vector<pair<string, pair<LValAST*, int>>>& Rows() const {
+        return rows;
+    }
+
+    /**
+     * @brief whether the loop calls a function, not a builtin, in which
+     * case no row is hoisted
+     */
+    bool HasCall() const { return hasCall; }
+
+    /**
+     * @brief get the key of the row of the first k indices of lval, like
+     * "%local_a.1[%local_i.2]", or "" if the indices are not simple
+     * @note vars are spelled with their mangled names, so that the vars
+     * shadowed in inner scopes do not match
+     *
+     * @param scope the current scope
+     * @param lval the LValAST
+     * @param k the number of indices
+     * @return string
+     */
+    static string Key(Scope* scope, LValAST* lval, int k) {
+        auto obj = scope->Lookup(lval->sym);
+        if (obj == nullptr) {
+            return "";
+        }
+        string key = obj->MangledName;
+        for (int i = 0; i < k; i++) {
+            auto idx = IndexKey(scope, lval->indexList->at(i).get());
+            if (idx == "") {
+                return "";
+            }
+            key += "[" + idx + "]";
+        }
+        return key;
+    }
+
+    /**
+     * @brief get the key of a simple index like "i + 1", or ""
+     */
+    static string IndexKey(Scope* scope, BaseAST* exp) {
+        switch (exp->type()) {
+            case TType::NumberT:
+                return to_string(reinterpret_cast<NumberAST*>(exp)->num);
+            case TType::LValT: {
+                auto lval = reinterpret_cast<LValAST*>(exp);
+                auto obj = scope->Lookup(lval->sym);
+                if (!lval->indexList->empty() || obj == nullptr) {
+                    return "";
+                }
+                return obj->MangledName;
+            }
+            case TType::BinExpT: {
+                auto bin = reinterpret_cast<BinExpAST*>(exp);
+                auto l = IndexKey(scope, bin->left.get());
+                auto r = IndexKey(scope, bin->right.get());
+                if (l == "" || r == "") {
+                    return "";
+                }
+                return "(" + l + " " + to_string(bin->op) + " " + r + ")";
+            }
+            case TType::UnaryExpT: {
+                auto unary = reinterpret_cast<UnaryExpAST*>(exp);
+                auto p = IndexKey(scope, unary->p.get());
+                return p == "" ? "" : string("(") + unary->op + p + ")";
+            }
+            case TType::ParenExpT:
+                return IndexKey(scope, reinterpret_cast<ParenExpAST*>(exp)->p.get());
+            default:
+                return "";
+        }
+    }
+};
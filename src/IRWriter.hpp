@@ -0,0 +1,177 @@
+#pragma once
+
+/**
+ * @file IRWriter.hpp
+ * @author Asilvorcarp (asilvorcarp@qq.com)
+ * @brief the buffers the LLVM IR is written to
+ * @version 2.0
+ * @date 2023-06-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <Error.hpp>
+
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief a temp file name next to the path, unique to each call in this
+ * process and among processes, to be written and then renamed over the path
+ * @note threads of the batch mode share the pid, so the counter tells apart
+ * the temp files of two threads writing the same path
+ */
+inline string TempPath(const string& path) {
+    static atomic<uint64_t> next = 0;
+    return path + "." + to_string(getpid()) + "." + to_string(next++) +
+           ".tmp";
+}
+
+/**
+ * @brief a streambuf writing to a file descriptor through a fixed buffer
+ * @note the buffer is flushed when full, so the memory used does not grow
+ * with the size of the output
+ */
+class FdBuf : public streambuf {
+    int fd;
+    vector<char> buf;
+
+    /**
+     * @brief write all the bytes to the fd
+     */
+    void writeAll(const char* p, size_t n) {
+        while (n > 0) {
+            auto ret = ::write(fd, p, n);
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                cerr << "FdBuf: write failed - " << strerror(errno) << endl;
+                throw CompileError();
+            }
+            p += ret;
+            n -= ret;
+        }
+    }
+
+    /**
+     * @brief write the buffered bytes to the fd
+     */
+    void flushBuf() {
+        writeAll(pbase(), pptr() - pbase());
+        setp(buf.data(), buf.data() + buf.size());
+    }
+
+   protected:
+    int_type overflow(int_type c) override {
+        flushBuf();
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    streamsize xsputn(const char* s, streamsize n) override {
+        if (n > epptr() - pptr()) {
+            flushBuf();
+            if (n >= (streamsize)buf.size()) {
+                // too large to buffer
+                writeAll(s, n);
+                return n;
+            }
+        }
+        memcpy(pptr(), s, n);
+        pbump(n);
+        return n;
+    }
+
+    int sync() override {
+        flushBuf();
+        return 0;
+    }
+
+   public:
+    /**
+     * @brief Construct a new FdBuf object
+     *
+     * @param fd the file descriptor, which is not closed by this
+     * @param size the size of the buffer in bytes
+     */
+    FdBuf(int fd, size_t size = 1 << 20) : fd(fd), buf(size) {
+        setp(buf.data(), buf.data() + buf.size());
+    }
+    FdBuf(const FdBuf&) = delete;
+    FdBuf& operator=(const FdBuf&) = delete;
+    ~FdBuf() override { flushBuf(); }
+};
+
+/**
+ * @brief a streambuf appending to a string, which can be cleared and reused
+ * without freeing the memory
+ * @note tellp() on its ostream is the size of the string, which SSABuilder
+ * uses as the offsets of the blocks
+ */
+class StringBuf : public streambuf {
+    string buf;
+
+   protected:
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            buf.push_back(traits_type::to_char_type(c));
+        }
+        return traits_type::not_eof(c);
+    }
+
+    streamsize xsputn(const char* s, streamsize n) override {
+        buf.append(s, n);
+        return n;
+    }
+
+    pos_type seekoff(off_type off, ios_base::seekdir dir,
+                     ios_base::openmode which) override {
+        if (off != 0 || dir != ios_base::cur || !(which & ios_base::out)) {
+            return pos_type(off_type(-1));
+        }
+        return pos_type(buf.size());
+    }
+
+   public:
+    /**
+     * @brief get the string written
+     */
+    const string& str() const { return buf; }
+
+    /**
+     * @brief clear the string but keep its memory
+     */
+    void clear() { buf.clear(); }
+};
+
+/**
+ * @brief format an int to a name, like "%t" + 12 to "%t12"
+ *
+ * @param prefix the prefix
+ * @param n the number
+ * @return string
+ */
+inline string numbered(const string& prefix, long long n) {
+    char digits[24];
+    auto end = to_chars(digits, digits + sizeof(digits), n).ptr;
+    string ret;
+    ret.reserve(prefix.size() + (end - digits));
+    ret += prefix;
+    ret.append(digits, end);
+    return ret;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+/**
+ * @file Intern.hpp
+ * @author Asilvorcarp (asilvorcarp@qq.com)
+ * @brief the interned names of a compilation
+ * @version 2.0
+ * @date 2023-06-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+using namespace std;
+
+/**
+ * @brief the id of an interned name, the same name always has the same id
+ * @note 0 is no name
+ */
+using Symbol = uint32_t;
+
+/**
+ * @brief the table of the names of a compilation, from the lexer to the
+ * scopes, so that names are compared and hashed as ints
+ */
+class Interner {
+    // a deque never moves its strings, so the views in ids stay valid
+    deque<string> names;
+    unordered_map<string_view, Symbol> ids;
+
+   public:
+    Interner() { names.emplace_back(); }
+    Interner(const Interner&) = delete;
+    Interner& operator=(const Interner&) = delete;
+
+    /**
+     * @brief get the id of the name, adding it if new
+     *
+     * @param name the name
+     * @return Symbol - the id
+     */
+    Symbol Intern(string_view name) {
+        auto it = ids.find(name);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        Symbol id = names.size();
+        names.emplace_back(name);
+        ids.emplace(names.back(), id);
+        return id;
+    }
+
+    /**
+     * @brief get the name of the id
+     *
+     * @param id the id from Intern()
+     * @return const string& - the name, valid as long as the interner
+     */
+    const string& Name(Symbol id) const { return names[id]; }
+};
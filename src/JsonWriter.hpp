@@ -0,0 +1,155 @@
+#pragma once
+
+/**
+ * @file JsonWriter.hpp
+ * @author Asilvorcarp (asilvorcarp@qq.com)
+ * @brief the writer of the AST json, streamed to an ostream
+ * @version 2.0
+ * @date 2023-06-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief write json to an ostream as it goes, indented like json::dump(4)
+ * @note nothing is built in memory but the nesting, so a large AST is
+ * dumped in memory bounded by its depth
+ * @note the keys are in the order they are written, not sorted
+ */
+class JsonWriter {
+    ostream& os;
+    int indent;
+    /**
+     * @brief the number of items written in each open object or array
+     */
+    vector<size_t> counts;
+    /**
+     * @brief a key is written, so the next value is its value
+     */
+    bool afterKey = false;
+
+    void newline() {
+        os << '\n';
+        for (size_t i = 0; i < counts.size() * indent; i++) {
+            os << ' ';
+        }
+    }
+
+    /**
+     * @brief start an item of the current object or array
+     */
+    void item() {
+        if (afterKey) {
+            afterKey = false;
+            return;
+        }
+        if (!counts.empty()) {
+            if (counts.back()++ > 0) {
+                os << ',';
+            }
+            newline();
+        }
+    }
+
+    void open(char c) {
+        item();
+        os << c;
+        counts.push_back(0);
+    }
+
+    void close(char c) {
+        assert(!counts.empty() && !afterKey);
+        auto n = counts.back();
+        counts.pop_back();
+        if (n > 0) {
+            newline();
+        }
+        os << c;
+        if (counts.empty()) {
+            os << '\n';
+        }
+    }
+
+    void quoted(string_view s) {
+        static const char hex[] = "0123456789abcdef";
+        os << '"';
+        for (unsigned char c : s) {
+            switch (c) {
+                case '"': os << "\\\""; break;
+                case '\\': os << "\\\\"; break;
+                case '\n': os << "\\n"; break;
+                case '\t': os << "\\t"; break;
+                case '\r': os << "\\r"; break;
+                case '\b': os << "\\b"; break;
+                case '\f': os << "\\f"; break;
+                default:
+                    if (c < 0x20) {
+                        os << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+                    } else {
+                        os << c;
+                    }
+            }
+        }
+        os << '"';
+    }
+
+   public:
+    /**
+     * @brief Construct a new JsonWriter object
+     *
+     * @param os the ostream to write to
+     * @param indent the spaces of each level
+     */
+    JsonWriter(ostream& os, int indent = 4) : os(os), indent(indent) {}
+    JsonWriter(const JsonWriter&) = delete;
+    JsonWriter& operator=(const JsonWriter&) = delete;
+
+    void BeginObject() { open('{'); }
+    void EndObject() { close('}'); }
+    void BeginArray() { open('['); }
+    void EndArray() { close(']'); }
+
+    /**
+     * @brief write the key of the next value in the current object
+     */
+    void Key(string_view key) {
+        item();
+        quoted(key);
+        os << ": ";
+        afterKey = true;
+    }
+
+    void Value(string_view s) {
+        item();
+        quoted(s);
+    }
+    void Value(const char* s) { Value(string_view(s)); }
+    void Value(int64_t n) {
+        item();
+        os << n;
+    }
+    void Value(int n) { Value(int64_t(n)); }
+    void Value(bool b) {
+        item();
+        os << (b ? "true" : "false");
+    }
+
+    /**
+     * @brief write the key and the value
+     */
+    template <class T>
+    void Field(string_view key, const T& value) {
+        Key(key);
+        Value(value);
+    }
+};
@@ -0,0 +1,344 @@
+#pragma once
+
+/**
+ * @file SSA.hpp
+ * @author Asilvorcarp (asilvorcarp@qq.com)
+ * @brief build SSA form for the local vars of a function on the fly
+ * @version 2.0
+ * @date 2023-06-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <Type.hpp>
+
+using namespace std;
+
+/**
+ * @brief build SSA form for the promoted vars of one function while the IR is
+ * being emitted, so that they live in virtual registers instead of allocas
+ * @note the algorithm is from "Simple and Efficient Construction of Static
+ * Single Assignment Form" (Braun et al.), which needs no dominator tree
+ * @note phis are collected here and spliced into the function text in
+ * finish(), after the trivial ones are removed
+ */
+class SSABuilder {
+    /**
+     * @brief a basic block of the function
+     */
+    struct Block {
+        string label;
+        vector<int> preds;
+        /**
+         * @brief whether all the preds are known
+         */
+        bool sealed = false;
+        /**
+         * @brief the offset in the function text right after the label,
+         * where the phis of this block go
+         */
+        size_t phiPos = 0;
+        /**
+         * @brief phis created before the block is sealed, (var, phi)
+         */
+        vector<pair<string, int>> incompletePhis;
+    };
+
+    /**
+     * @brief a phi, with operands (value, pred block)
+     */
+    struct Phi {
+        string name;
+        string var;
+        int block;
+        vector<pair<string, int>> operands;
+        /**
+         * @brief trivial phi replaced by the value in alias
+         */
+        bool removed = false;
+    };
+
+    /**
+     * @brief a promoted var with its current def in each block
+     */
+    struct Var {
+        const Type* ty;
+        unordered_map<int, string> defs;
+    };
+
+    vector<Block> blocks;
+    unordered_map<string, int> blockIds;
+    vector<Phi> phis;
+    unordered_map<string, int> phiIds;
+    unordered_map<string, Var> vars;
+    /**
+     * @brief the removed phi -> the value replacing it
+     */
+    unordered_map<string, string> alias;
+    /**
+     * @brief the current block, -1 after a terminator
+     */
+    int cur = -1;
+
+    int blockOf(const string& label) {
+        auto it = blockIds.find(label);
+        if (it != blockIds.end()) {
+            return it->second;
+        }
+        blocks.push_back(Block{label});
+        blockIds[label] = blocks.size() - 1;
+        return blocks.size() - 1;
+    }
+
+    string newPhi(const string& var, int block) {
+        auto name = "%phi" + to_string(phis.size());
+        phiIds[name] = phis.size();
+        phis.push_back(Phi{name, var, block});
+        return name;
+    }
+
+    void writeVar(const string& var, int block, const string& val) {
+        vars[var].defs[block] = val;
+    }
+
+    string readVar(const string& var, int block) {
+        auto& defs = vars[var].defs;
+        auto it = defs.find(block);
+        if (it != defs.end()) {
+            return it->second;
+        }
+        return readVarRecursive(var, block);
+    }
+
+    string readVarRecursive(const string& var, int block) {
+        string val;
+        if (!blocks[block].sealed) {
+            // preds unknown yet, fill the operands when sealed
+            val = newPhi(var, block);
+            blocks[block].incompletePhis.push_back({var, phiIds[val]});
+        } else if (blocks[block].preds.size() == 1) {
+            // no phi needed
+            val = readVar(var, blocks[block].preds[0]);
+        } else if (blocks[block].preds.empty()) {
+            // unreachable, or read before any def
+            val = "undef";
+        } else {
+            // write first to break the cycles of loops
+            val = newPhi(var, block);
+            writeVar(var, block, val);
+            addPhiOperands(phiIds[val]);
+        }
+        writeVar(var, block, val);
+        return val;
+    }
+
+    void addPhiOperands(int phi) {
+        // note: phis may grow while reading, so index instead of reference
+        auto block = phis[phi].block;
+        auto var = phis[phi].var;
+        vector<pair<string, int>> operands;
+        for (auto pred : blocks[block].preds) {
+            operands.push_back({readVar(var, pred), pred});
+        }
+        phis[phi].operands = operands;
+    }
+
+    string resolve(string val) {
+        auto it = alias.find(val);
+        while (it != alias.end()) {
+            val = it->second;
+            it = alias.find(val);
+        }
+        return val;
+    }
+
+    /**
+     * @brief remove the phis whose operands are all the same value (or
+     * itself), until nothing changes
+     */
+    void removeTrivialPhis() {
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (auto& phi : phis) {
+                if (phi.removed) {
+                    continue;
+                }
+                string same = "";
+                bool trivial = true;
+                for (auto& [val, _] : phi.operands) {
+                    auto v = resolve(val);
+                    if (v == phi.name || v == same) {
+                        continue;
+                    }
+                    if (same != "") {
+                        trivial = false;
+                        break;
+                    }
+                    same = v;
+                }
+                if (trivial) {
+                    alias[phi.name] = same == "" ? "undef" : same;
+                    phi.removed = true;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+   public:
+    /**
+     * @brief promote a var, which is then read and written by value
+     *
+     * @param var the mangled name of the var
+     * @param ty the type of the var
+     */
+    void declare(const string& var, const Type* ty) { vars[var].ty = ty; }
+
+    /**
+     * @brief whether the var is promoted
+     *
+     * @param var the mangled name of the var
+     */
+    bool isPromoted(const string& var) const { return vars.count(var) > 0; }
+
+    /**
+     * @brief set the value of a promoted var in the current block
+     */
+    void write(const string& var, const string& val) {
+        if (cur != -1) {
+            writeVar(var, cur, val);
+        }
+    }
+
+    /**
+     * @brief get the value of a promoted var in the current block
+     *
+     * @return string - a temp, a phi, an immediate, "null" or "undef"
+     */
+    string read(const string& var) {
+        if (cur == -1) {
+            return "undef";
+        }
+        return readVar(var, cur);
+    }
+
+    /**
+     * @brief start a block, its label is just written to the function text
+     *
+     * @param label the label of the block
+     * @param phiPos the offset in the function text after the label
+     */
+    void startBlock(const string& label, size_t phiPos) {
+        cur = blockOf(label);
+        blocks[cur].phiPos = phiPos;
+    }
+
+    /**
+     * @brief whether the code emitted now is reachable, i.e. the current
+     * block is not terminated
+     */
+    bool reachable() const { return cur != -1; }
+
+    /**
+     * @brief get the label of the current block
+     */
+    const string& currentLabel() const { return blocks[cur].label; }
+
+    /**
+     * @brief whether the current block can never be executed
+     * @note the first block is the entry, which has no preds
+     */
+    bool deadBlock() const {
+        return cur == -1 || (cur != 0 && blocks[cur].preds.empty());
+    }
+
+    /**
+     * @brief add an edge from the current block to the target
+     */
+    void addEdge(const string& target) {
+        if (cur != -1) {
+            blocks[blockOf(target)].preds.push_back(cur);
+        }
+    }
+
+    /**
+     * @brief end the current block after a terminator
+     */
+    void terminate() { cur = -1; }
+
+    /**
+     * @brief mark that all the preds of the block are known
+     *
+     * @param label the label of the block
+     */
+    void seal(const string& label) {
+        auto block = blockOf(label);
+        for (auto& [_, phi] : blocks[block].incompletePhis) {
+            addPhiOperands(phi);
+        }
+        blocks[block].incompletePhis.clear();
+        blocks[block].sealed = true;
+    }
+
+    /**
+     * @brief write the function text with the phis inserted, and the removed
+     * phis replaced with their values
+     *
+     * @param out the ostream to write to
+     * @param text the function text written along with this builder
+     * @param entryCode the code to put at the beginning of the entry block,
+     * like the allocas
+     */
+    void finish(ostream& out, const string& text,
+                const string& entryCode = "") {
+        removeTrivialPhis();
+        // the phis at each offset
+        vector<pair<size_t, string>> inserts;
+        if (!blocks.empty() && !entryCode.empty()) {
+            inserts.push_back({blocks[0].phiPos, entryCode});
+        }
+        for (auto& phi : phis) {
+            if (phi.removed) {
+                continue;
+            }
+            string line = "\t" + phi.name + " = phi " + vars[phi.var].ty->str();
+            for (int i = 0; i < phi.operands.size(); i++) {
+                auto& [val, pred] = phi.operands[i];
+                line += i == 0 ? " " : ", ";
+                line += "[ " + resolve(val) + ", %" + blocks[pred].label + " ]";
+            }
+            inserts.push_back({blocks[phi.block].phiPos, line + "\n"});
+        }
+        stable_sort(inserts.begin(), inserts.end(),
+                    [](auto& a, auto& b) { return a.first < b.first; });
+        inserts.push_back({text.size(), ""});
+        // copy the text in chunks between the inserts and the uses of phis
+        size_t pos = 0;
+        size_t nextPhi = text.find("%phi");
+        for (auto& [at, code] : inserts) {
+            while (nextPhi < at) {
+                out.write(text.data() + pos, nextPhi - pos);
+                size_t j = nextPhi + 4;
+                while (j < text.size() && isdigit(text[j])) {
+                    j++;
+                }
+                out << resolve(text.substr(nextPhi, j - nextPhi));
+                pos = j;
+                nextPhi = text.find("%phi", pos);
+            }
+            out.write(text.data() + pos, at - pos);
+            out << code;
+            pos = at;
+        }
+    }
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <AST.hpp>
+#include <Type.hpp>
 
 using namespace std;
 
@@ -11,6 +12,10 @@ using namespace std;
  */
 class Object {
    public:
+    /**
+     * @brief the id of the name, which the scopes are keyed on
+     */
+    Symbol Sym;
     /**
      * @brief the original name
     */
@@ -25,97 +30,167 @@ class Object {
      * which can be a FuncDefAST, VarSpecAST, or LValAST
      */
     BaseAST* Node;
+    /**
+     * @brief the type of the object, a FuncType for functions
+     */
+    const Type* Ty;
 
     Object() = delete;
     /**
      * @brief Construct a new Object object
      * 
+     * @param sym the id of the name
      * @param name the original name
      * @param mangledName the mangled name used in the LLVM IR
-     * @param node the AST node of the object to get the type information
+     * @param node the AST node of the object
+     * @param ty the type of the object
      */
-    Object(string name, string mangledName, BaseAST* node)
-        : Name(name), MangledName(mangledName), Node(node) {}
+    Object(Symbol sym, string name, string mangledName, BaseAST* node,
+           const Type* ty)
+        : Sym(sym),
+          Name(name),
+          MangledName(mangledName),
+          Node(node),
+          Ty(ty) {}
 };
 
 /**
- * @brief A scope in the program
- * @note The scope is a tree structure, and the root is the universe scope
- * @note The universe scope contains all the runtime functions
+ * @brief The scopes of the program, as one table of the visible objects
+ * @note The table is indexed by the Symbol of the name, which is dense in a
+ * compilation, so a lookup is a single probe without hashing
+ * @note Entering a scope only marks the undo log, and leaving it restores
+ * the objects shadowed by the ones inserted since the mark
+ * @note The universe scope, at depth 0, contains all the runtime functions
  */
 class Scope {
+    /**
+     * @brief the visible object of a name and the depth it is inserted at
+     */
+    struct Binding {
+        Object* Obj = nullptr;
+        uint Depth = 0;
+    };
+    /**
+     * @brief the binding of each Symbol, nullptr if not visible
+     */
+    vector<Binding> bindings;
+    /**
+     * @brief the bindings replaced by Insert, (the Symbol, the last binding)
+     */
+    vector<pair<Symbol, Binding>> undoLog;
+    /**
+     * @brief the size of the undo log when each scope is entered
+     */
+    vector<size_t> marks;
+
+    Binding& bindingOf(Symbol sym) {
+        if (sym >= bindings.size()) {
+            bindings.resize(sym + 1);
+        }
+        return bindings[sym];
+    }
+
    public:
+    Scope() = default;
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+    ~Scope() {
+        while (!marks.empty()) {
+            Leave();
+        }
+        for (auto& b : bindings) {
+            delete b.Obj;
+        }
+    }
+
     /**
-    * @brief The outer scope of the current scope
-    */
-    Scope* Outer;
+     * @brief the number of scopes entered, 0 for the universe scope
+     */
+    uint Depth() const { return marks.size(); }
+
     /**
-     * @brief The map from the name to the object
-     * @note The name is the original name of the object, while the mangled name
-     * is the name used in the LLVM IR
+     * @brief enter a new scope in the current scope
      */
-    map<string, Object*> Objs;
+    void Enter() { marks.push_back(undoLog.size()); }
 
     /**
-     * @brief Construct a new Scope object
-     * 
-     * @param outer the outer scope of the current scope
+     * @brief leave the current scope, the objects inserted in it are deleted
      */
-    Scope(Scope* outer) : Outer(outer) { Objs = map<string, Object*>(); }
+    void Leave() {
+        if (marks.empty()) {
+            cerr << "error: leave the universe scope" << endl;
+            throw CompileError();
+        }
+        auto mark = marks.back();
+        marks.pop_back();
+        while (undoLog.size() > mark) {
+            auto& [sym, last] = undoLog.back();
+            delete bindings[sym].Obj;
+            bindings[sym] = last;
+            undoLog.pop_back();
+        }
+    }
 
     /**
-     * @brief Check if the scope has the object with the given name
+     * @brief Check if the current scope has the object with the given name
      * 
-     * @param name the name of the object
+     * @param sym the id of the name of the object
      * @return true 
      * @return false 
      */
-    bool HasName(string name) { return Objs.find(name) != Objs.end(); }
+    bool HasName(Symbol sym) const {
+        return sym < bindings.size() && bindings[sym].Obj != nullptr &&
+               bindings[sym].Depth == Depth();
+    }
 
     /**
-     * @brief Lookup the object with the given name in the scope
+     * @brief Lookup the object with the given name in the current scope and
+     * the outer ones
      * 
-     * @param name the name of the object
-     * @return pair<Scope*, Object*> the scope containing the object and the object
+     * @param sym the id of the name of the object
+     * @return Object* - the object, or nullptr if not found
      */
-    pair<Scope*, Object*> Lookup(string name) {
-        if (HasName(name)) {
-            return make_pair(this, Objs[name]);
-        }
-        if (Outer != nullptr) {
-            return Outer->Lookup(name);
-        }
-        return make_pair(nullptr, nullptr);
+    Object* Lookup(Symbol sym) const {
+        return sym < bindings.size() ? bindings[sym].Obj : nullptr;
     }
 
     /**
-     * @brief Insert the object into the scope
+     * @brief Insert the object into the current scope, which owns it then
      * 
      * @param obj the object to be inserted
      * @return Object* - the object with the same name in the scope, or nullptr if
      * no object with the same name exists
+     * @note obj is not inserted (nor owned) if the name exists in the scope
      */
     Object* Insert(Object* obj) {
-        if (HasName(obj->Name)) {
-            return Objs[obj->Name];
+        auto& b = bindingOf(obj->Sym);
+        if (b.Obj != nullptr && b.Depth == Depth()) {
+            return b.Obj;
+        }
+        if (!marks.empty()) {
+            undoLog.push_back({obj->Sym, b});
         }
-        Objs[obj->Name] = obj;
+        b = {obj, Depth()};
         return nullptr;
     }
 
     /**
-     * @brief Convert the scope to json
+     * @brief Write the visible objects as json
      * 
-     * @return json
-     */
-    json toJson() const {
-        json j;
-        j["type"] = "Scope";
-        j["Objs"] = json::array();
-        for (auto& obj : Objs) {
-            j["Objs"].push_back(obj.second->Node->toJson());
+     * @param w the writer
+     */
+    void toJson(JsonWriter& w) const {
+        w.BeginObject();
+        w.Field("type", "Scope");
+        w.Key("Objs");
+        w.BeginArray();
+        for (auto& b : bindings) {
+            if (b.Obj != nullptr) {
+                b.Obj->Node->toJson(w);
+            }
         }
-        return j;
+        w.EndArray();
+        w.EndObject();
     }
 
     /**
@@ -124,24 +199,53 @@ class Scope {
      * @return string 
      */
     friend ostream& operator<<(ostream& os, const Scope& s) {
-        return os << s.toJson().dump(4);
+        JsonWriter w(os);
+        s.toJson(w);
+        return os;
     }
 
     /**
      * @brief Get the universe scope, which contains all the runtime functions
+     * and the builtin functions
      * 
+     * @param types the context to get the types of runtime functions from
+     * @param names the interner of the names in the file
      * @return Scope* - the universe scope
      */
-    static Scope* Universe() {
-        auto universe = new Scope(nullptr);
+    static Scope* Universe(TypeContext& types, Interner& names) {
+        auto universe = new Scope();
+        auto i64 = types.Int();
         // --- Add Runtime Functions Here ---
-        // no malloc because it is called by make()
+        // no malloc or runtime_alloc because they are called by make()
+        universe->Insert(
+            new Object(names.Intern("getchar"), "getchar",
+                       "@runtime_getchar",
+                       new RuntimeFuncAST("i64", new vector<string>()),
+                       types.Func(i64, {})));
         universe->Insert(
-            new Object("getchar", "@getchar",
-                       new RuntimeFuncAST("i64", new vector<string>())));
+            new Object(names.Intern("putchar"), "putchar",
+                       "@runtime_putchar",
+                       new RuntimeFuncAST("i64", new vector<string>{"i64"}),
+                       types.Func(i64, {i64})));
+        // readInt() and writeInt(n) do the digits in the runtime, which is
+        // much faster than getchar() and putchar() for each digit
         universe->Insert(
-            new Object("putchar", "@putchar",
-                       new RuntimeFuncAST("i64", new vector<string>{"i64"})));
+            new Object(names.Intern("readInt"), "readInt",
+                       "@runtime_readInt",
+                       new RuntimeFuncAST("i64", new vector<string>()),
+                       types.Func(i64, {})));
+        universe->Insert(
+            new Object(names.Intern("writeInt"), "writeInt",
+                       "@runtime_writeInt",
+                       new RuntimeFuncAST("void", new vector<string>{"i64"}),
+                       types.Func(types.Void(), {i64})));
+        // --- Builtin Functions, compiled inline ---
+        // the param of len() and cap() is any array, checked by the compiler
+        for (auto name : {"len", "cap"}) {
+            universe->Insert(new Object(names.Intern(name), name, name,
+                                        new BuiltinFuncAST(name),
+                                        types.Func(i64, {})));
+        }
         return universe;
     }
 };
@@ -150,26 +254,41 @@ class Scope {
  * @brief The header of the generated LLVM IR, including the runtime functions
  * @note The runtime functions are:
  * - i8* @malloc(i64)
- * - i64 @getchar()
- * - i64 @putchar(i64)
+ * - i8* @calloc(i64, i64), for the zeroed arrays from make()
+ * - void @llvm.memset.p0i8.i64(i8*, i8, i64, i1), to zero small arrays
+ * - i8* @runtime_alloc(i64), the arena used by make() with --arena
+ * - i64 @runtime_getchar()
+ * - i64 @runtime_putchar(i64)
+ * - i64 @runtime_readInt()
+ * - void @runtime_writeInt(i64)
+ * - void @runtime_flush()
  * @note here, i8* stands for void* or opaque pointer
+ * @note the runtime_* functions are buffered, see src/runtime.c
  */
 const static string Header = R"(
 target triple = "x86_64-pc-linux-gnu"
 
 declare i8* @malloc(i64)
-declare i64 @getchar()
-declare i64 @putchar(i64)
+declare i8* @calloc(i64, i64)
+declare void @llvm.memset.p0i8.i64(i8*, i8, i64, i1)
+declare i8* @runtime_alloc(i64)
+declare i64 @runtime_getchar()
+declare i64 @runtime_putchar(i64)
+declare i64 @runtime_readInt()
+declare void @runtime_writeInt(i64)
+declare void @runtime_flush()
 )";
 
 /**
  * @brief The fake main function of the generated LLVM IR
  * @note main_init() is called before main_main() to initialize the globals
+ * @note the buffered output is flushed at the end
  */
 const string MainMain = R"(
 define i64 @main() {
 	call void() @main_init()
 	call void() @main_main()
+	call void() @runtime_flush()
 	ret i64 0
 }
 )";
@@ -0,0 +1,97 @@
+#pragma once
+
+/**
+ * @file Source.hpp
+ * @author Asilvorcarp (asilvorcarp@qq.com)
+ * @brief the source file mapped into memory for the lexer
+ * @version 2.0
+ * @date 2023-06-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <Error.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+/**
+ * @brief a source file mapped with mmap, followed by 2 zero bytes so that
+ * flex scans it in place by yy_scan_buffer, without copying it
+ * @note the mapping is private and writable, since flex writes a '\0' after
+ * each token while scanning, which copies only the pages it touches
+ */
+class SourceFile {
+    char* base = nullptr;
+    size_t len = 0;
+    size_t mapped = 0;
+    // the buffer of an empty file, which cannot be mapped
+    char empty[2] = {0, 0};
+
+   public:
+    /**
+     * @brief Construct a new SourceFile object, mapping the file
+     *
+     * @param path the path of the source file
+     */
+    SourceFile(const string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) < 0) {
+            cerr << "error: cannot open " << path << endl;
+            throw CompileError();
+        }
+        len = st.st_size;
+        if (len == 0) {
+            close(fd);
+            base = empty;
+            return;
+        }
+        // reserve zeroed pages for the file and the 2 bytes after it, then
+        // map the file over them, the bytes after the file stay zero
+        long page = sysconf(_SC_PAGESIZE);
+        mapped = (len + 2 + page - 1) / page * page;
+        void* p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED ||
+            mmap(p, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd,
+                 0) == MAP_FAILED) {
+            cerr << "error: cannot map " << path << endl;
+            throw CompileError();
+        }
+        close(fd);
+        base = static_cast<char*>(p);
+        madvise(base, len, MADV_SEQUENTIAL);
+    }
+    ~SourceFile() {
+        if (mapped != 0) {
+            munmap(base, mapped);
+        }
+    }
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    /**
+     * @brief the source code, valid as long as the SourceFile
+     */
+    string_view Text() const { return string_view(base, len); }
+
+    /**
+     * @brief the buffer for yy_scan_buffer, the source and 2 zero bytes
+     */
+    char* Buffer() { return base; }
+
+    /**
+     * @brief the size of Buffer(), the length of the source plus 2
+     */
+    size_t BufferSize() const { return len + 2; }
+};
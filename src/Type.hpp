@@ -0,0 +1,266 @@
+#pragma once
+
+/**
+ * @file Type.hpp
+ * @author Asilvorcarp (asilvorcarp@qq.com)
+ * @brief the types of miniGo values, interned in a TypeContext
+ * @version 2.0
+ * @date 2023-06-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <Error.hpp>
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief the kinds of types
+ */
+enum class TypeKind {
+    IntT,
+    VoidT,
+    NilT,
+    PointerT,
+    ArrayT,
+    FuncT,
+};
+
+class TypeContext;
+
+/**
+ * @brief the base class of all types
+ * @note types are interned by TypeContext, so two types are the same iff
+ * their pointers are equal
+ */
+class Type {
+    friend class TypeContext;
+
+   protected:
+    /**
+     * @brief the spelling in LLVM IR, like "i64*" or "[5 x [4 x i64]]"
+     * @note built once when the type is interned
+     */
+    string llName;
+    /**
+     * @brief the pointer type to this type, created on demand
+     */
+    mutable const Type* ptrTo = nullptr;
+
+    Type(TypeKind kind, string llName) : llName(llName), kind(kind) {}
+
+   public:
+    /**
+     * @brief the kind of the type
+     */
+    const TypeKind kind;
+
+    virtual ~Type() = default;
+    Type(const Type&) = delete;
+    Type& operator=(const Type&) = delete;
+
+    /**
+     * @brief get the spelling of the type in LLVM IR
+     *
+     * @return const string&
+     */
+    const string& str() const { return llName; }
+
+    bool isInt() const { return kind == TypeKind::IntT; }
+    bool isVoid() const { return kind == TypeKind::VoidT; }
+    bool isNil() const { return kind == TypeKind::NilT; }
+    bool isArray() const { return kind == TypeKind::ArrayT; }
+    bool isFunc() const { return kind == TypeKind::FuncT; }
+    /**
+     * @brief whether the type is a pointer
+     * @note nil counts as a pointer because it matches any pointer
+     */
+    bool isPtr() const {
+        return kind == TypeKind::PointerT || kind == TypeKind::NilT;
+    }
+
+    /**
+     * @brief get the element type of a pointer or array type
+     * @note change "[5 x [4 x i64]]" to "[4 x i64]"
+     * @note change "i64**" to "i64*"
+     *
+     * @return const Type*
+     */
+    virtual const Type* elem() const {
+        cerr << "Type: not an array type - " << llName << endl;
+        throw CompileError();
+    }
+
+    /**
+     * @brief get the size of the type in bytes on x86_64
+     *
+     * @return int
+     */
+    virtual int size() const { return 8; }
+};
+
+/**
+ * @brief the int type, i64 in LLVM IR
+ */
+class IntType : public Type {
+    friend class TypeContext;
+    IntType() : Type(TypeKind::IntT, "i64") {}
+};
+
+/**
+ * @brief the void type, only for function return type
+ */
+class VoidType : public Type {
+    friend class TypeContext;
+    VoidType() : Type(TypeKind::VoidT, "void") {}
+
+   public:
+    int size() const override { return 0; }
+};
+
+/**
+ * @brief the type of nil, which matches any pointer
+ */
+class NilType : public Type {
+    friend class TypeContext;
+    NilType() : Type(TypeKind::NilT, "nil") {}
+};
+
+/**
+ * @brief the pointer type, like "i64*" for []int
+ */
+class PointerType : public Type {
+    friend class TypeContext;
+    const Type* elemType;
+    PointerType(const Type* elemType)
+        : Type(TypeKind::PointerT, elemType->str() + "*"),
+          elemType(elemType) {}
+
+   public:
+    const Type* elem() const override { return elemType; }
+};
+
+/**
+ * @brief the array type with const length, like "[5 x i64]" for [5]int
+ */
+class ArrayType : public Type {
+    friend class TypeContext;
+    const Type* elemType;
+    ArrayType(const Type* elemType, int len)
+        : Type(TypeKind::ArrayT,
+               "[" + to_string(len) + " x " + elemType->str() + "]"),
+          elemType(elemType),
+          len(len) {}
+
+   public:
+    /**
+     * @brief the number of elements
+     */
+    const int len;
+
+    const Type* elem() const override { return elemType; }
+    int size() const override { return len * elemType->size(); }
+};
+
+/**
+ * @brief the function type, like "i64(i64, i64*)"
+ */
+class FuncType : public Type {
+    friend class TypeContext;
+    FuncType(const Type* ret, vector<const Type*> params)
+        : Type(TypeKind::FuncT, spell(ret, params)), ret(ret), params(params) {}
+
+    static string spell(const Type* ret, const vector<const Type*>& params) {
+        string s = ret->str() + "(";
+        for (int i = 0; i < params.size(); i++) {
+            s += params[i]->str();
+            if (i != params.size() - 1) s += ", ";
+        }
+        s += ")";
+        return s;
+    }
+
+   public:
+    /**
+     * @brief the return type, maybe void
+     */
+    const Type* ret;
+    /**
+     * @brief the types of the parameters
+     */
+    const vector<const Type*> params;
+};
+
+/**
+ * @brief the owner of all types, which makes each type unique
+ */
+class TypeContext {
+    IntType intType;
+    VoidType voidType;
+    NilType nilType;
+    vector<unique_ptr<Type>> owned;
+    map<pair<const Type*, int>, const Type*> arrays;
+    map<pair<const Type*, vector<const Type*>>, const Type*> funcs;
+
+   public:
+    TypeContext() = default;
+    TypeContext(const TypeContext&) = delete;
+    TypeContext& operator=(const TypeContext&) = delete;
+
+    const Type* Int() { return &intType; }
+    const Type* Void() { return &voidType; }
+    const Type* Nil() { return &nilType; }
+
+    /**
+     * @brief get the pointer type to t
+     *
+     * @param t the element type
+     * @return const Type*
+     */
+    const Type* PointerTo(const Type* t) {
+        if (t->ptrTo == nullptr) {
+            owned.push_back(unique_ptr<Type>(new PointerType(t)));
+            t->ptrTo = owned.back().get();
+        }
+        return t->ptrTo;
+    }
+
+    /**
+     * @brief get the array type of len elements of t
+     *
+     * @param t the element type
+     * @param len the number of elements
+     * @return const Type*
+     */
+    const Type* ArrayOf(const Type* t, int len) {
+        auto& ret = arrays[{t, len}];
+        if (ret == nullptr) {
+            owned.push_back(unique_ptr<Type>(new ArrayType(t, len)));
+            ret = owned.back().get();
+        }
+        return ret;
+    }
+
+    /**
+     * @brief get the function type
+     *
+     * @param ret the return type
+     * @param params the types of the parameters
+     * @return const Type*
+     */
+    const Type* Func(const Type* ret, vector<const Type*> params) {
+        auto& f = funcs[{ret, params}];
+        if (f == nullptr) {
+            owned.push_back(unique_ptr<Type>(new FuncType(ret, params)));
+            f = owned.back().get();
+        }
+        return f;
+    }
+};
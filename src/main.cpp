@@ -1,10 +1,28 @@
 #include <AST.hpp>
+#include <AstFile.hpp>
+#include <Cache.hpp>
 #include <Compiler.hpp>
+#include <Emitter.hpp>
+#include <IRWriter.hpp>
+#include <Source.hpp>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <chrono>
 #include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 using namespace std;
 
@@ -14,83 +32,464 @@ using namespace std;
 // 你的代码编辑器/IDE 很可能找不到这个文件, 然后会给你报错 (虽然编译不会出错)
 // 看起来会很烦人, 于是干脆采用这种看起来 dirty 但实际很有效的手段
 
-extern FILE *yyin;
-extern int yyparse(unique_ptr<BaseAST> &ast);
+// the lexer and the parser are reentrant, the state of each parse is in its
+// own yyscan_t and ParseContext
+typedef void *yyscan_t;
+extern int yylex_init_extra(ParseContext *ctx, yyscan_t *scanner);
+extern int yylex_destroy(yyscan_t scanner);
+// scan the buffer in place, which must end with 2 '\0'
+struct yy_buffer_state;
+extern yy_buffer_state *yy_scan_buffer(char *base, size_t size,
+                                       yyscan_t scanner);
+extern int yyparse(yyscan_t scanner, unique_ptr<BaseAST> &ast,
+                   ParseContext &ctx);
 extern int yydebug;
 
-uint BaseAST::counter = 0;
+// the options from the command line
+struct Options {
+    string input;
+    string output = "a.ll";
+    // make() allocates from the arena of the runtime instead of malloc
+    bool arena = false;
+    // run the program with the JIT instead of writing the output
+    bool run = false;
+    // the directory of the cached outputs, no cache if empty
+    string cacheDir;
+    // the file to dump the AST to as json, no dump if empty
+    string dumpAst;
+    // the file to save the AST to in the binary format, see AstFile.hpp
+    string emitAst;
+    // the inputs of the batch mode, compiled to .ll by `jobs` threads
+    vector<string> batch;
+    int jobs = thread::hardware_concurrency();
+
+    // the options changing the output, part of the key of the cache
+    string flags() const {
+        return "kind=" + to_string((int)emitKindOf(output)) +
+               " arena=" + to_string(arena);
+    }
+};
+
+// the time of each part of a build in ms
+struct Timing {
+    double parse = 0;
+    double compile = 0;
+    bool cached = false;
+    // the file has an error, which is printed to cerr
+    bool failed = false;
+};
+
+// the ms since the time point
+static double msSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start)
+        .count();
+}
+
+// .go to .ll, or .bc / .o if built with LLVM, or run it with the JIT
+// returns the exit code, and throws CompileError if the file has an error
+int buildFile(const Options &opts, Timing &timing) {
+    auto &inFile = opts.input;
+    auto &outLL = opts.output;
+    auto start = chrono::steady_clock::now();
+
+    // the source is mapped, not read, and scanned in place
+    SourceFile source(inFile);
+
+    // an unchanged source compiled with the same flags is not compiled again
+    unique_ptr<CompileCache> cache;
+    string key;
+    // the AST is not dumped or saved from the cache
+    if (!opts.cacheDir.empty() && !opts.run && opts.dumpAst.empty() &&
+        opts.emitAst.empty()) {
+        cache = make_unique<CompileCache>(opts.cacheDir);
+        key = CompileCache::Key(source.Text(), opts.flags());
+        if (cache->Fetch(key, outLL)) {
+            timing.cached = true;
+            return 0;
+        }
+    }
+    // silent to suppress output
+    // the stdout is the program's when running it, and the batch mode
+    // prints a report instead
+    bool verbose = !opts.run && opts.batch.empty();
+#ifdef SILENT
+    verbose = false;
+#endif
 
-// .go to .ll
-void build(string inFile, string outLL) {
     // >> scan and parse
 #ifdef YYDEBUG
     yydebug = 1;
 #endif
-    yyin = fopen(inFile.c_str(), "r");
-    assert(yyin);
-
+    // the labels of each file are numbered from 0, so that its output never
+    // depends on the other files in the batch mode
+    ParseContext ctx;
+    // the nodes are from the arena of ctx, which stays the current one until
+    // the AST is freed, since delete of a node checks if the arena owns it,
+    // so use is declared after ctx and before ast
+    AstArena::Use use(ctx.arena);
     unique_ptr<BaseAST> ast;
+    if (AstReader::IsAstFile(source.Text())) {
+        // saved by --emit-ast, so it is not parsed again
+        ast = AstReader(source.Text(), ctx).Read();
+    } else {
+        // the lexer interns the names into ctx
+        yyscan_t scanner;
+        yylex_init_extra(&ctx, &scanner);
+        auto buf =
+            yy_scan_buffer(source.Buffer(), source.BufferSize(), scanner);
+        assert(buf);
 
-    // silent to suppress output
-#ifndef SILENT
-    cout << ">> parsing... " << endl;
-#endif
-    auto ret = yyparse(ast);
-#ifndef SILENT
-    cout << ">> done" << endl;
-#endif
+        if (verbose) {
+            cout << ">> parsing... " << endl;
+        }
+        int ret;
+        try {
+            ret = yyparse(scanner, ast, ctx);
+        } catch (const CompileError &) {
+            yylex_destroy(scanner);
+            throw;
+        }
+        if (verbose) {
+            cout << ">> done" << endl;
+        }
+        // the buffer is freed too, but not the source
+        yylex_destroy(scanner);
 
-    assert(!ret);
+        if (ret != 0) {
+            cerr << "error: cannot parse " << inFile << endl;
+            throw CompileError();
+        }
+    }
+    timing.parse = msSince(start);
+    start = chrono::steady_clock::now();
 
     // // print ast as json to stdin
     // cout << ">> ast: " << endl;
     // cout << *ast << endl;
 
-    // output ast to json file
-#ifndef SILENT
-    FILE *astFp = fopen("ast.o.json", "w");
-    fprintf(astFp, "%s", ast->toJson().dump(4).c_str());
-    fclose(astFp);
-#endif
+    // save the ast before the compiler changes it
+    if (!opts.emitAst.empty()) {
+        auto bytes =
+            AstWriter().Write(reinterpret_cast<CompUnitAST *>(ast.get()));
+        ofstream out(opts.emitAst, ios::binary);
+        out.write(bytes.data(), bytes.size());
+        if (!out) {
+            cerr << "error: cannot write " << opts.emitAst << endl;
+            throw CompileError();
+        }
+    }
+
+    // output ast to json file, streamed node by node
+    if (!opts.dumpAst.empty()) {
+        int astFd = open(opts.dumpAst.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                         0644);
+        if (astFd < 0) {
+            cerr << "error: cannot open " << opts.dumpAst << " - "
+                 << strerror(errno) << endl;
+            throw CompileError();
+        }
+        {
+            FdBuf buf(astFd);
+            ostream out(&buf);
+            out << *ast;
+        }
+        close(astFd);
+    }
 
     // >> compile to .ll
-    auto compiler = Compiler();
+    auto compiler = Compiler(ctx.names);
 
 #ifdef YYDEBUG
     compiler.debug = true;
 #endif
+    if (opts.arena) {
+        compiler.allocFunc = "@runtime_alloc";
+    }
     auto unit = reinterpret_cast<CompUnitAST *>(ast.get());
-    string ll = compiler.Compile(unit);
 
-    // // output ast with dynamic information to json file
-    // FILE *astDFp = fopen("ast.o.json", "w");
-    // fprintf(astDFp, "%s", ast->toJson().dump(4).c_str());
-    // fclose(astDFp);
+    if (opts.run) {
+#ifdef MINIGO_LLVM
+        ModuleEmitter emitter(
+            [&](ostream &os) { compiler.Compile(unit, os); });
+        emitter.LinkRuntime();
+        emitter.Optimize(2);
+        return emitter.Run();
+#else
+        cerr << "error: built without LLVM, run `make llvm` to use run"
+             << endl;
+        throw CompileError();
+#endif
+    }
 
-    // print ll to file output
-    FILE *fp = fopen(outLL.c_str(), "w");
-    fprintf(fp, "%s", ll.c_str());
-    fclose(fp);
+    auto kind = emitKindOf(outLL);
+    if (kind != EmitKind::IRE) {
+        // .bc or .o, optimized and written in process
+#ifdef MINIGO_LLVM
+        auto stage = chrono::steady_clock::now();
+        ModuleEmitter emitter(
+            [&](ostream &os) { compiler.Compile(unit, os); });
+        auto irMs = msSince(stage) - emitter.parseMs;
+        stage = chrono::steady_clock::now();
+        emitter.LinkRuntime();
+        emitter.Optimize(2);
+        auto optMs = msSince(stage);
+        stage = chrono::steady_clock::now();
+        emitter.Write(outLL, kind);
+        if (verbose) {
+            // the share of parsing the textual IR, see Readme.md
+            cout << ">> ms: " << irMs << " to compile to IR, "
+                 << emitter.parseMs << " to parse it, " << optMs
+                 << " to optimize, " << msSince(stage) << " to emit"
+                 << endl;
+        }
+        if (cache) {
+            cache->Store(key, outLL);
+        }
+        timing.compile = msSince(start);
+        return 0;
+#else
+        cerr << "error: built without LLVM, run `make llvm` to emit " << outLL
+             << endl;
+        throw CompileError();
+#endif
+    }
 
+    // stream ll to a temp file, renamed when done so that no partial output
+    // is left if the compiler fails, the temp name is unique so that two
+    // threads of the batch mode writing the same output never share it
+    string tmpLL = TempPath(outLL);
+    int fd = open(tmpLL.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        cerr << "error: cannot open " << tmpLL << " - " << strerror(errno)
+             << endl;
+        throw CompileError();
+    }
+    try {
+        FdBuf buf(fd);
+        ostream out(&buf);
+        compiler.Compile(unit, out);
+    } catch (const CompileError &) {
+        close(fd);
+        unlink(tmpLL.c_str());
+        throw;
+    }
+    // a failed close or rename leaves no output, so the build fails too
+    if (close(fd) < 0 || rename(tmpLL.c_str(), outLL.c_str()) < 0) {
+        cerr << "error: cannot write " << outLL << " - " << strerror(errno)
+             << endl;
+        unlink(tmpLL.c_str());
+        throw CompileError();
+    }
+    if (cache) {
+        cache->Store(key, outLL);
+    }
+    timing.compile = msSince(start);
+    return 0;
 }
 
-int main(int argc, const char *argv[]) {
-    // compiler input -o output
-    // compiler input
-
-    string input, output;
-    if (argc == 4) {
-        assert(argv[2] == string("-o"));
-        input = argv[1];
-        output = argv[3];
-    } else if (argc == 2) {
-        input = argv[1];
-        output = "a.ll";
-    } else {
-        assert(0);
+// build the file, which fails with 1 instead of aborting if it has an error,
+// so that the other files of the batch mode go on
+int build(const Options &opts, Timing &timing) {
+    try {
+        return buildFile(opts, timing);
+    } catch (const CompileError &) {
+        timing.failed = true;
+        return 1;
+    }
+}
+
+// compile each of opts.batch to .ll on a pool of threads, each with its own
+// parser and Compiler, then report the time of each file to stderr
+int buildBatch(const Options &opts) {
+    auto &inputs = opts.batch;
+    // X.go to X.ll, in the output dir if given
+    vector<string> outputs(inputs.size());
+    for (size_t i = 0; i < inputs.size(); i++) {
+        auto out = inputs[i].substr(0, inputs[i].rfind(".go")) + ".ll";
+        if (!opts.output.empty()) {
+            out = opts.output + "/" + out.substr(out.rfind('/') + 1);
+        }
+        outputs[i] = out;
     }
+    // two inputs of the same name in different dirs would overwrite the
+    // output of each other, a file listed twice only writes the same one
+    map<filesystem::path, size_t> firstOf;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        auto out = filesystem::weakly_canonical(outputs[i]);
+        auto [it, added] = firstOf.emplace(out, i);
+        auto j = it->second;
+        if (!added && filesystem::weakly_canonical(inputs[j]) !=
+                          filesystem::weakly_canonical(inputs[i])) {
+            cerr << "error: " << inputs[j] << " and " << inputs[i]
+                 << " are both compiled to " << outputs[i] << endl;
+            return 1;
+        }
+    }
+    vector<Timing> timings(inputs.size());
+    atomic<size_t> next = 0;
+    auto start = chrono::steady_clock::now();
+    auto worker = [&]() {
+        for (size_t i = next++; i < inputs.size(); i = next++) {
+            auto fileOpts = opts;
+            fileOpts.input = inputs[i];
+            fileOpts.output = outputs[i];
+            build(fileOpts, timings[i]);
+        }
+    };
+    int jobs = max(1, min(opts.jobs, (int)inputs.size()));
+    vector<thread> pool;
+    for (int i = 0; i < jobs; i++) {
+        pool.emplace_back(worker);
+    }
+    for (auto &t : pool) {
+        t.join();
+    }
+    auto wall = msSince(start);
 
-    build(input, output);
+    // the report
+    Timing total;
+    int cached = 0;
+    int failed = 0;
+    fprintf(stderr, "%12s %12s  %s\n", "parse(ms)", "compile(ms)", "file");
+    for (size_t i = 0; i < inputs.size(); i++) {
+        auto &t = timings[i];
+        total.parse += t.parse;
+        total.compile += t.compile;
+        cached += t.cached;
+        failed += t.failed;
+        fprintf(stderr, "%12.2f %12.2f  %s%s\n", t.parse, t.compile,
+                inputs[i].c_str(),
+                t.failed ? " (failed)" : t.cached ? " (cached)" : "");
+    }
+    fprintf(stderr,
+            "%12.2f %12.2f  total of %zu files, %d cached, %d failed\n",
+            total.parse, total.compile, inputs.size(), cached, failed);
+    fprintf(stderr, ">> %.2f ms with %d threads\n", wall, jobs);
+    return failed > 0 ? 1 : 0;
+}
 
+// run the command making the output from the inputs, or copy the output
+// from the cache if the same command made it from the same inputs before,
+// so that the .s and binaries of the Makefile are cached like the .ll
+int runCached(const string &cacheDir, const string &output,
+              const vector<string> &inputs, const vector<string> &command) {
+    CompileCache cache(cacheDir);
+    string key;
+    try {
+        key = CompileCache::CommandKey(command, inputs);
+    } catch (const CompileError &) {
+        return 1;
+    }
+    if (cache.Fetch(key, output)) {
+        return 0;
+    }
+    vector<char *> args;
+    for (auto &arg : command) {
+        args.push_back(const_cast<char *>(arg.c_str()));
+    }
+    args.push_back(nullptr);
+    pid_t pid;
+    if (posix_spawnp(&pid, args[0], nullptr, nullptr, args.data(), environ) !=
+        0) {
+        cerr << "error: cannot run " << command[0] << endl;
+        return 1;
+    }
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)) {
+        cerr << "error: " << command[0] << " failed" << endl;
+        return 1;
+    }
+    if (WEXITSTATUS(status) != 0) {
+        return WEXITSTATUS(status);
+    }
+    cache.Store(key, output);
     return 0;
 }
+
+int main(int argc, const char *argv[]) {
+    // compiler input [-o output] [--arena] [--cache dir] [--dump-ast file]
+    //   [--emit-ast file]
+    // compiler run input [--arena] [--dump-ast file] [--emit-ast file]
+    // the input is a .go file, or a binary AST saved by --emit-ast
+    // compiler batch inputs... [--list file] [-j jobs] [-o dir] [--arena]
+    //   [--cache dir]
+    // compiler cached --cache dir -o output inputs... -- command...
+
+    if (argc > 1 && argv[1] == string("cached")) {
+        string cacheDir, output;
+        vector<string> inputs, command;
+        int i = 2;
+        for (; i < argc && argv[i] != string("--"); i++) {
+            string arg = argv[i];
+            if (arg == "--cache") {
+                assert(i + 1 < argc);
+                cacheDir = argv[++i];
+            } else if (arg == "-o") {
+                assert(i + 1 < argc);
+                output = argv[++i];
+            } else {
+                inputs.push_back(arg);
+            }
+        }
+        command.assign(argv + min(i + 1, argc), argv + argc);
+        assert(!cacheDir.empty() && !output.empty() && !command.empty());
+        return runCached(cacheDir, output, inputs, command);
+    }
+
+    Options opts;
+    int first = 1;
+    bool batch = false;
+    if (argc > 1 && argv[1] == string("run")) {
+        opts.run = true;
+        first = 2;
+    } else if (argc > 1 && argv[1] == string("batch")) {
+        batch = true;
+        opts.output = "";
+        first = 2;
+    }
+    for (int i = first; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-o") {
+            assert(i + 1 < argc);
+            opts.output = argv[++i];
+        } else if (arg == "--arena") {
+            opts.arena = true;
+        } else if (arg == "--cache") {
+            assert(i + 1 < argc);
+            opts.cacheDir = argv[++i];
+        } else if (!batch && arg == "--dump-ast") {
+            assert(i + 1 < argc);
+            opts.dumpAst = argv[++i];
+        } else if (!batch && arg == "--emit-ast") {
+            assert(i + 1 < argc);
+            opts.emitAst = argv[++i];
+        } else if (batch && arg == "-j") {
+            assert(i + 1 < argc);
+            opts.jobs = stoi(argv[++i]);
+        } else if (batch && arg == "--list") {
+            // a file with one input on each line
+            assert(i + 1 < argc);
+            ifstream list(argv[++i]);
+            assert(list);
+            string line;
+            while (getline(list, line)) {
+                if (!line.empty()) {
+                    opts.batch.push_back(line);
+                }
+            }
+        } else if (batch) {
+            opts.batch.push_back(arg);
+        } else {
+            assert(opts.input.empty());
+            opts.input = arg;
+        }
+    }
+    if (batch) {
+        assert(!opts.batch.empty());
+        return buildBatch(opts);
+    }
+    assert(!opts.input.empty());
+
+    Timing timing;
+    return build(opts, timing);
+}
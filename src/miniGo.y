@@ -3,6 +3,12 @@
   #include <memory>
   #include <string>
   #include <AST.hpp>
+
+  // the state of the reentrant lexer, the same as the one defined by flex
+  #ifndef YY_TYPEDEF_YY_SCANNER_T
+  #define YY_TYPEDEF_YY_SCANNER_T
+  typedef void *yyscan_t;
+  #endif
 }
 
 %{
@@ -13,18 +19,26 @@
 #include <string>
 #include <AST.hpp>
 
-// 声明 lexer 函数和错误处理函数
-int yylex();
-void yyerror(pAST &ast, const char *s);
-
 using namespace std;
 
 %}
 
+%code {
+// 声明 lexer 函数和错误处理函数
+// the lexer is reentrant, so yylval and the scanner are passed to it
+int yylex(YYSTYPE *yylval, yyscan_t scanner);
+void yyerror(yyscan_t scanner, pAST &ast, ParseContext &ctx, const char *s);
+}
+
+// a pure parser, with no globals, so files can be parsed at the same time
+%define api.pure full
+%lex-param { yyscan_t scanner }
+
 // 定义 parser 函数和错误处理函数的附加参数
 // 我们需要返回一个字符串作为 AST, 所以我们把附加参数定义成字符串的智能指针
 // 解析完成后, 我们要手动修改这个参数, 把它设置成解析得到的字符串
-%parse-param { pAST &ast }
+// the scanner and the context are of this parse only
+%parse-param { yyscan_t scanner } { pAST &ast } { ParseContext &ctx }
 
 // yylval 的定义, 我们把它定义成了一个联合体 (union)
 // 因为 token 的值有的是字符串指针, 有的是整数
@@ -33,20 +47,22 @@ using namespace std;
 // 请自行 STFW 在 union 里写一个带析构函数的类会出现什么情况
 %union {
   string *str_val;
+  Symbol sym_val;
   int int_val;
   char char_val;
   BaseAST *ast_val;
   vpAST *ast_list;
-  vector<string> *str_list;
+  vector<Symbol> *sym_list;
   vector<int> *int_list;
 }
 
 // lexer 返回的所有 token 种类的声明
-// 注意 IDENT 和 INT_CONST 会返回 token 的值, 分别对应 str_val 和 int_val
+// 注意 IDENT 和 INT_CONST 会返回 token 的值, 分别对应 sym_val 和 int_val
+// the names and the 2-char ops are interned by the lexer, see ParseContext
 %token INT RETURN PACKAGE IMPORT IF ELSE FOR DEFINE
     BREAK CONTINUE DEFER GOTO VAR FUNC CONST
     INC DEC MAKE NIL
-%token <str_val> IDENT LE GE EQ NE AND OR BIN_ASSIGN
+%token <sym_val> IDENT LE GE EQ NE AND OR BIN_ASSIGN
 %token <int_val> INT_CONST
 %token <char_val> CHAR_CONST '+' '-' '*' '/' '%' '!' '&' '|' '^' '<' '>' '=' 
 
@@ -54,9 +70,10 @@ using namespace std;
 %type <ast_val> FuncDef ReturnType Block Stmt ReturnStmt Exp ExpStmt IncDecStmt AssignStmt ShortVarDecl LVal Param BType TopLevelDecl PrimaryExp UnaryExp MulExp AddExp RelExp EqExp LAndExp LOrExp VarDecl ConstDecl VarSpec ConstSpec ForStmt SimpleStmt Decl IfStmt InitVal BranchStmt
 %type <int_val> Number ConstIndex ConstExp ConstInitVal
 %type <char_val> AddOp MulOp UnaryOp
-%type <str_val> RelOp EqOp PackClause
+%type <sym_val> RelOp EqOp
+%type <str_val> PackClause
 %type <ast_list> TopLevelDeclList ParamList StmtList ArgList InitVals InitValList LVals
-%type <str_list> IDs
+%type <sym_list> IDs
 %type <int_list> ConstIndexList ConstInitVals
 
 // - about their emptyness -
@@ -93,7 +110,7 @@ TopLevelDeclList : /* empty */ {
     $$ = l;
 };
 PackClause : PACKAGE IDENT {
-    $$ = $2;
+    $$ = new string(ctx.names.Name($2));
 };
 
 // FuncDef ::= ReturnType IDENT '(' ')' Block;
@@ -109,7 +126,7 @@ PackClause : PACKAGE IDENT {
 // TODO: void func type, param list
 
 Param : IDENT BType {
-    auto ast = new ParamAST($1, $2);
+    auto ast = new ParamAST($1, ctx.names.Name($1), $2);
     $$ = ast;
 };
 
@@ -126,7 +143,7 @@ ParamList : /* empty */ {
 };
 
 FuncDef : FUNC IDENT '(' ParamList ')' ReturnType Block {
-    auto ast = new FuncDefAST($2, $4, $6, $7);
+    auto ast = new FuncDefAST($2, ctx.names.Name($2), $4, $6, $7);
     $$ = ast;
 };
 
@@ -170,7 +187,7 @@ AssignStmt : LVals '=' InitVals {
     auto ast = new ShortVarDeclAST(false, $1, $3);
     $$ = ast;
 } | LVal BIN_ASSIGN InitVal {
-    char op = (*$2)[0];
+    char op = ctx.names.Name($2)[0];
     $$ = new ShortVarDeclAST($1, op, $3);
 };
 // i, j := 0, 10
@@ -236,19 +253,19 @@ BranchStmt : BREAK {
     $$ = ast;
 } | GOTO IDENT {
     auto ast = new BranchStmtAST(
-        BranchStmtAST::Type::Goto, $2);
+        BranchStmtAST::Type::Goto, ctx.names.Name($2));
     $$ = ast;
 };
 ForStmt : FOR Block { // always
-    auto ast = new ForStmtAST(
+    auto ast = new ForStmtAST(ctx.nextForId++,
         nullptr, nullptr, nullptr, $2);
     $$ = ast;
 } | FOR Exp Block { // while
-    auto ast = new ForStmtAST(
+    auto ast = new ForStmtAST(ctx.nextForId++,
         nullptr, $2, nullptr, $3);
     $$ = ast;
 } | FOR SimpleStmt ';' Exp ';' SimpleStmt Block { // for
-    auto ast = new ForStmtAST(
+    auto ast = new ForStmtAST(ctx.nextForId++,
         $2, $4, $6, $7);
     $$ = ast;
 };
@@ -264,12 +281,12 @@ Stmt : Decl | IfStmt | ReturnStmt | SimpleStmt | ForStmt | Block | BranchStmt ;
 // array: var a [2]type
 // TODO now only support one var decl
 IDs : IDENT {
-    auto l = new vector<string>();
-    l->push_back(*unique_ptr<string>($1));
+    auto l = new vector<Symbol>();
+    l->push_back($1);
     $$ = l;
 } | IDs ',' IDENT {
     auto l = $1;
-    l->push_back(*unique_ptr<string>($3));
+    l->push_back($3);
     $$ = l;
 };
 // initVal can be exp, array exp, make exp
@@ -307,13 +324,13 @@ VarDecl : VAR VarSpec {
     $$ = $2;
 };
 VarSpec : IDs BType '=' InitVals {
-    auto ast = new VarSpecAST($1, $2, $4);
+    auto ast = new VarSpecAST(ctx.names, $1, $2, $4);
     $$ = ast;
 }| IDs '=' InitVals {
-    auto ast = new VarSpecAST($1, nullptr, $3);
+    auto ast = new VarSpecAST(ctx.names, $1, nullptr, $3);
     $$ = ast;
 }| IDs BType {
-    auto ast = new VarSpecAST($1, $2, nullptr);
+    auto ast = new VarSpecAST(ctx.names, $1, $2, nullptr);
     $$ = ast;
 };
 ConstDecl : CONST ConstSpec {
@@ -348,7 +365,7 @@ Number : INT_CONST | CHAR_CONST {
 };
 Exp : LOrExp;
 LVal : IDENT {
-    auto ast = new LValAST($1, nullptr);
+    auto ast = new LValAST($1, ctx.names.Name($1), nullptr);
     $$ = ast;
 } | LVal '[' Exp ']' {
     auto ast = $1;
@@ -372,7 +389,7 @@ PrimaryExp : '(' Exp ')' {
     $$ = new NilAST();
 };
 UnaryExp : PrimaryExp | IDENT '(' ArgList ')' {
-    $$ = new CallExpAST($1, $3);
+    $$ = new CallExpAST($1, ctx.names.Name($1), $3);
 } | UnaryOp UnaryExp {
     $$ = new UnaryExpAST($1, $2);
 };
@@ -398,19 +415,19 @@ AddExp: MulExp | AddExp AddOp MulExp {
 };
 AddOp: '+' | '-';
 RelExp: AddExp | RelExp RelOp AddExp {
-    $$ = new BinExpAST($2, $1, $3);
+    $$ = new BinExpAST(ctx.names.Name($2), $1, $3);
 };
-RelOp: '<' {$$=new string(yytext);} | '>' {$$=new string(yytext);} 
+RelOp: '<' {$$=ctx.names.Intern("<");} | '>' {$$=ctx.names.Intern(">");}
      | LE | GE;
 EqExp: RelExp | EqExp EqOp RelExp {
-    $$ = new BinExpAST($2, $1, $3);
+    $$ = new BinExpAST(ctx.names.Name($2), $1, $3);
 };
 EqOp: EQ | NE;
 LAndExp: EqExp | LAndExp AND EqExp {
-    $$ = new BinExpAST($2, $1, $3);
+    $$ = new BinExpAST(ctx.names.Name($2), $1, $3);
 };
 LOrExp: LAndExp | LOrExp OR LAndExp {
-    $$ = new BinExpAST($2, $1, $3);
+    $$ = new BinExpAST(ctx.names.Name($2), $1, $3);
 };
 ConstExp: Exp {
     // error if not const
@@ -423,6 +440,6 @@ ConstExp: Exp {
 
 // 定义错误处理函数, 其中第二个参数是错误信息
 // parser 如果发生错误 (例如输入的程序出现了语法错误), 就会调用这个函数
-void yyerror(pAST &ast, const char *s) {
+void yyerror(yyscan_t scanner, pAST &ast, ParseContext &ctx, const char *s) {
   cerr << "error: " << s << endl;
 }
@@ -0,0 +1,230 @@
+/**
+ * @file runtime.c
+ * @author Asilvorcarp (asilvorcarp@qq.com)
+ * @brief the runtime of miniGo, linked with the generated code
+ * @version 2.0
+ * @date 2023-06-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * @note getchar and putchar work on 64 KiB buffers instead of calling libc
+ * for each char, and the output is flushed by runtime_flush() at the end of
+ * @main, see MainMain in src/Scope.hpp
+ * @note readInt and writeInt convert the digits right in the buffers
+ * @note runtime_alloc is the arena make() calls instead of malloc with
+ * --arena, nothing is freed until the program exits
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define BUF_SIZE (64 * 1024)
+
+static unsigned char inBuf[BUF_SIZE];
+static int64_t inPos = 0;
+static int64_t inLen = 0;
+
+static unsigned char outBuf[BUF_SIZE];
+static int64_t outLen = 0;
+
+/**
+ * @brief write the buffered output to stdout
+ */
+void runtime_flush(void) {
+    int64_t done = 0;
+    while (done < outLen) {
+        ssize_t ret = write(1, outBuf + done, outLen - done);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        done += ret;
+    }
+    outLen = 0;
+}
+
+/**
+ * @brief read a char from stdin
+ *
+ * @return int64_t - the char, or -1 at the end of input
+ */
+int64_t runtime_getchar(void) {
+    if (inPos == inLen) {
+        // show the output before waiting for the input
+        runtime_flush();
+        ssize_t ret;
+        do {
+            ret = read(0, inBuf, BUF_SIZE);
+        } while (ret < 0 && errno == EINTR);
+        if (ret <= 0) {
+            return -1;
+        }
+        inPos = 0;
+        inLen = ret;
+    }
+    return inBuf[inPos++];
+}
+
+/**
+ * @brief write a char to stdout
+ *
+ * @param c the char
+ * @return int64_t - the char
+ */
+int64_t runtime_putchar(int64_t c) {
+    if (outLen == BUF_SIZE) {
+        runtime_flush();
+    }
+    outBuf[outLen++] = (unsigned char)c;
+    return c;
+}
+
+/**
+ * @brief whether the 8 chars in v are all digits
+ */
+static int isEightDigits(uint64_t v) {
+    return ((v & 0xF0F0F0F0F0F0F0F0) |
+            (((v + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ==
+           0x3333333333333333;
+}
+
+/**
+ * @brief parse the 8 digits in v at once (SWAR), the first char is the
+ * lowest byte
+ */
+static uint64_t parseEightDigits(uint64_t v) {
+    v -= 0x3030303030303030;
+    // pairs of digits, then pairs of pairs
+    v = v * 10 + (v >> 8);
+    return (((v & 0x000000FF000000FF) * (100 + (1000000ULL << 32))) +
+            (((v >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32)))) >>
+           32;
+}
+
+/**
+ * @brief read an int from stdin, like the getInt() of the tests
+ * @note the chars before the digits are skipped, and it is negative if a
+ * '-' is skipped; the char after the digits is consumed too
+ *
+ * @return int64_t - the int, or 0 at the end of input
+ */
+int64_t runtime_readInt(void) {
+    int64_t sign = 1;
+    int64_t c = runtime_getchar();
+    while (c < '0' || c > '9') {
+        if (c == -1) {
+            return 0;
+        }
+        if (c == '-') {
+            sign = -1;
+        }
+        c = runtime_getchar();
+    }
+    uint64_t n = c - '0';
+    // 8 digits at a time while they are in the buffer
+    while (inLen - inPos >= 8) {
+        uint64_t v;
+        memcpy(&v, inBuf + inPos, 8);
+        if (!isEightDigits(v)) {
+            break;
+        }
+        n = n * 100000000 + parseEightDigits(v);
+        inPos += 8;
+    }
+    c = runtime_getchar();
+    while (c >= '0' && c <= '9') {
+        n = n * 10 + (c - '0');
+        c = runtime_getchar();
+    }
+    return sign * (int64_t)n;
+}
+
+/**
+ * @brief the 2-digit strings of 0 to 99
+ */
+static const char digitPairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+/**
+ * @brief write an int to stdout in decimal
+ *
+ * @param n the int
+ */
+void runtime_writeInt(int64_t n) {
+    // at most 20 chars, like -9223372036854775808
+    char tmp[20];
+    char* end = tmp + sizeof(tmp);
+    char* p = end;
+    uint64_t u = n < 0 ? -(uint64_t)n : (uint64_t)n;
+    while (u >= 100) {
+        p -= 2;
+        memcpy(p, digitPairs + 2 * (u % 100), 2);
+        u /= 100;
+    }
+    if (u >= 10) {
+        p -= 2;
+        memcpy(p, digitPairs + 2 * u, 2);
+    } else {
+        *--p = '0' + u;
+    }
+    if (n < 0) {
+        *--p = '-';
+    }
+    if (outLen + (end - p) > BUF_SIZE) {
+        runtime_flush();
+    }
+    memcpy(outBuf + outLen, p, end - p);
+    outLen += end - p;
+}
+
+/**
+ * @brief the size of each chunk of the arena, only touched pages are
+ * backed by memory
+ */
+#define ARENA_CHUNK ((int64_t)64 << 20)
+
+static unsigned char* arenaPos = NULL;
+static unsigned char* arenaEnd = NULL;
+
+/**
+ * @brief map new memory from the OS, or exit if there is none
+ */
+static unsigned char* arenaMap(int64_t size) {
+    void* p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        runtime_flush();
+        static const char msg[] = "runtime: out of memory\n";
+        write(2, msg, sizeof(msg) - 1);
+        _exit(2);
+    }
+    return p;
+}
+
+/**
+ * @brief allocate from the arena by bumping a pointer, aligned to 16 bytes
+ * like malloc
+ * @note a size larger than a quarter of a chunk gets its own mapping, so the
+ * rest of the current chunk is not wasted
+ *
+ * @param size the size in bytes
+ * @return void* - the memory
+ */
+void* runtime_alloc(int64_t size) {
+    size = (size + 15) & ~(int64_t)15;
+    if (size > arenaEnd - arenaPos) {
+        if (size > ARENA_CHUNK / 4) {
+            return arenaMap(size);
+        }
+        arenaPos = arenaMap(ARENA_CHUNK);
+        arenaEnd = arenaPos + ARENA_CHUNK;
+    }
+    void* p = arenaPos;
+    arenaPos += size;
+    return p;
+}
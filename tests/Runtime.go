@@ -11,3 +11,27 @@ func getchar() int {
 func putchar(n int) {
 	fmt.Printf("%c", n)
 }
+
+func readInt() int {
+	sign := 1
+	c := getchar()
+	for c < '0' || c > '9' {
+		if c == 0 {
+			return 0
+		}
+		if c == '-' {
+			sign = -1
+		}
+		c = getchar()
+	}
+	n := 0
+	for c >= '0' && c <= '9' {
+		n = n*10 + c - '0'
+		c = getchar()
+	}
+	return sign * n
+}
+
+func writeInt(n int) {
+	fmt.Printf("%d", n)
+}